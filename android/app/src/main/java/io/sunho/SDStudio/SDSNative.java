@@ -1,12 +1,43 @@
 package io.sunho.SDStudio;
 
+import java.nio.ByteBuffer;
+
 public class SDSNative {
   static {
     System.loadLibrary("native");
   }
 
-  public native int createDB(String name);
-  public native Word[] search(int id, String input);
-  public native void loadDB(int id, String path);
+  public native int createDB(String name, SearchOptions options);
+  public native Word[] search(int id, String input, SearchOptions options);
+  public native int searchPacked(int id, String input, SearchOptions options, ByteBuffer out);
+  public native int searchManyPacked(int id, String[] queries, int k, SearchOptions options, ByteBuffer out, int[] queryOffsets);
+  public native Word[] lookupBatch(int id, String[] tags);
+  public native void loadDB(int id, String csv);
+  public native void loadDBWithSnapshot(int id, String csv, String snapshotPath);
+  public native boolean loadFile(int id, String path, String snapshotPath);
+  public native String getLoadStats(int id);
+  public native String[] getDanglingRedirects(int id);
+  public native void setLoadThreads(int id, int threads);
+  public native void setSearchThreads(int id, int threads);
+  public native String getCacheStats(int id);
+  public native String getSearchOptions(int id);
+  public native void setSearchOptions(int id, SearchOptions options);
+  public native void setCacheBudget(int id, long bytes);
+  public native String getStats(int id);
+  public native void resetStats(int id);
+  public native void setStatsEnabled(int id, boolean enabled);
+  public native boolean saveSnapshot(int id, String snapshotPath, String source);
+  public native boolean loadSnapshot(int id, String snapshotPath, String source);
+  public native boolean recordUsage(int id, String tag);
+  public native boolean saveUsage(int id, String usagePath);
+  public native boolean loadUsage(int id, String usagePath);
+  public native boolean upsert(int id, String word, int category, long freq, String redirect);
+  public native boolean remove(int id, String word);
+  public native int batchApply(int id, boolean[] removes, String[] words, int[] categories, long[] freqs, String[] redirects);
   public native void releaseDB(int id);
+  public native int createSearchSession(int id);
+  public native Word[] searchSession(int id, String input, SearchOptions options);
+  public native int searchSessionPacked(int id, String input, SearchOptions options, ByteBuffer out);
+  public native void releaseSearchSession(int id);
+  public native String getMemoryUsage(int id);
 }
@@ -0,0 +1,13 @@
+package io.sunho.SDStudio;
+
+// Budgets of a search, see SearchOptions in tagdb.hpp. A null field keeps
+// the value the database already has.
+public class SearchOptions {
+  public Integer scanBudget;
+  public Integer resultLimit;
+  public Boolean scoreShortened;
+  public Integer timeBudgetMs;
+  public Integer fuzzyResults;
+  public Integer fuzzyEdits;
+  public Integer fuzzyTimeBudgetMs;
+}
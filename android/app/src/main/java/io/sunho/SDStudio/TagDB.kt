@@ -8,10 +8,15 @@ import com.getcapacitor.PluginMethod
 import com.getcapacitor.annotation.CapacitorPlugin
 import org.json.JSONArray
 import org.json.JSONObject
+import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
 
 @CapacitorPlugin(name = "TagDB")
 class TagDB : Plugin() {
   private val sdsNative = SDSNative()
+  // Reused by every search and grown when a result does not fit.
+  private var packBuffer = ByteBuffer.allocateDirect(256 * 1024).order(ByteOrder.LITTLE_ENDIAN)
 
   @PluginMethod
   fun createDB(call: PluginCall) {
@@ -20,7 +25,7 @@ class TagDB : Plugin() {
       call.reject("Must provide a name")
       return
     }
-    val id = sdsNative.createDB(name)
+    val id = sdsNative.createDB(name, searchOptions(call))
     val ret = JSObject()
     ret.put("id", id)
     call.resolve(ret)
@@ -34,17 +39,60 @@ class TagDB : Plugin() {
       call.reject("Must provide id and query")
       return
     }
-    val results = sdsNative.search(id, query)
+    val options = searchOptions(call)
+    call.resolve(toResults(searchPacked { sdsNative.searchPacked(id, query, options, it) }))
+  }
+
+  // Runs every query in one native call and resolves to one result list per
+  // query, each holding at most k words.
+  @PluginMethod
+  fun searchMany(call: PluginCall) {
+    val id = call.getInt("id")
+    val queries = call.getArray("queries")
+    if (id == null || queries == null) {
+      call.reject("Must provide id and queries")
+      return
+    }
+    val k = call.getInt("k") ?: 256
+    val input = Array(queries.length()) { queries.getString(it) }
+    val offsets = IntArray(input.size + 1)
+    val options = searchOptions(call)
+    val words = searchPacked { sdsNative.searchManyPacked(id, input, k, options, it, offsets) }
+    val lists = JSArray()
+    for (i in input.indices) {
+      lists.put(JSArray(words.subList(offsets[i], offsets[i + 1])))
+    }
+    val ret = JSObject()
+    ret.put("results", lists)
+    call.resolve(ret)
+  }
+
+  // Resolves every tag of a prompt in one call. Unknown tags come back as
+  // null; known ones carry the word they canonicalize to.
+  @PluginMethod
+  fun lookupBatch(call: PluginCall) {
+    val id = call.getInt("id")
+    val tags = call.getArray("tags")
+    if (id == null || tags == null) {
+      call.reject("Must provide id and tags")
+      return
+    }
+    val input = Array(tags.length()) { tags.getString(it) }
     val resultArray = JSArray()
-    for (result in results) {
+    for (word in sdsNative.lookupBatch(id, input)) {
+      if (word == null) {
+        resultArray.put(JSONObject.NULL)
+        continue
+      }
       val obj = JSObject()
-      obj.put("normalized", result.normalized)
-      obj.put("shortened", result.shortened)
-      obj.put("word", result.word)
-      obj.put("redirect", result.redirect)
-      obj.put("freq", result.freq)
-      obj.put("priority", result.priority)
-      obj.put("category", result.category)
+      obj.put("normalized", word.normalized)
+      obj.put("shortened", word.shortened)
+      obj.put("word", word.word)
+      obj.put("redirect", word.redirect)
+      obj.put("freq", word.freq)
+      obj.put("priority", word.priority)
+      obj.put("category", word.category)
+      obj.put("canonical", if (word.redirect == "null") word.word else word.redirect)
       resultArray.put(obj)
     }
     val ret = JSObject()
@@ -54,16 +102,291 @@ class TagDB : Plugin() {
 
   @PluginMethod
   fun loadDB(call: PluginCall) {
+    val id = call.getInt("id")
+    val csv = call.getString("csv")
+    if (id == null || csv == null) {
+      call.reject("Must provide id and csv")
+      return
+    }
+    val snapshot = call.getString("snapshot")
+    if (snapshot != null) {
+      sdsNative.loadDBWithSnapshot(id, csv, snapshotPath(snapshot))
+    } else {
+      sdsNative.loadDB(id, csv)
+    }
+    call.resolve()
+  }
+
+  // Loads a CSV file from the app's files directory. The load runs on its
+  // own thread so that searches, which see the rows loaded so far, are not
+  // queued behind it; the call resolves once every row is in.
+  @PluginMethod
+  fun loadFile(call: PluginCall) {
     val id = call.getInt("id")
     val path = call.getString("path")
     if (id == null || path == null) {
       call.reject("Must provide id and path")
       return
     }
-    sdsNative.loadDB(id, path)
+    val snapshot = call.getString("snapshot")?.let { snapshotPath(it) }
+    val file = File(context.filesDir, path).absolutePath
+    Thread {
+      val ret = JSObject()
+      ret.put("loaded", sdsNative.loadFile(id, file, snapshot))
+      call.resolve(ret)
+    }.start()
+  }
+
+  @PluginMethod
+  fun getLoadStats(call: PluginCall) {
+    val id = call.getInt("id")
+    if (id == null) {
+      call.reject("Must provide id")
+      return
+    }
+    call.resolve(JSObject(sdsNative.getLoadStats(id)))
+  }
+
+  @PluginMethod
+  fun getDanglingRedirects(call: PluginCall) {
+    val id = call.getInt("id")
+    if (id == null) {
+      call.reject("Must provide id")
+      return
+    }
+    val ret = JSObject()
+    ret.put("redirects", JSArray(sdsNative.getDanglingRedirects(id).toList()))
+    call.resolve(ret)
+  }
+
+  @PluginMethod
+  fun setLoadThreads(call: PluginCall) {
+    val id = call.getInt("id")
+    val threads = call.getInt("threads")
+    if (id == null || threads == null) {
+      call.reject("Must provide id and threads")
+      return
+    }
+    sdsNative.setLoadThreads(id, threads)
+    call.resolve()
+  }
+
+  @PluginMethod
+  fun setSearchThreads(call: PluginCall) {
+    val id = call.getInt("id")
+    val threads = call.getInt("threads")
+    if (id == null || threads == null) {
+      call.reject("Must provide id and threads")
+      return
+    }
+    sdsNative.setSearchThreads(id, threads)
+    call.resolve()
+  }
+
+  @PluginMethod
+  fun getCacheStats(call: PluginCall) {
+    val id = call.getInt("id")
+    if (id == null) {
+      call.reject("Must provide id")
+      return
+    }
+    call.resolve(JSObject(sdsNative.getCacheStats(id)))
+  }
+
+  @PluginMethod
+  fun setCacheBudget(call: PluginCall) {
+    val id = call.getInt("id")
+    val bytes = call.getLong("bytes")
+    if (id == null || bytes == null) {
+      call.reject("Must provide id and bytes")
+      return
+    }
+    sdsNative.setCacheBudget(id, bytes)
+    call.resolve()
+  }
+
+  @PluginMethod
+  fun getSearchOptions(call: PluginCall) {
+    val id = call.getInt("id")
+    if (id == null) {
+      call.reject("Must provide id")
+      return
+    }
+    call.resolve(JSObject(sdsNative.getSearchOptions(id)))
+  }
+
+  // Changes the options given; the others keep their values.
+  @PluginMethod
+  fun setSearchOptions(call: PluginCall) {
+    val id = call.getInt("id")
+    val options = searchOptions(call)
+    if (id == null || options == null) {
+      call.reject("Must provide id and options")
+      return
+    }
+    sdsNative.setSearchOptions(id, options)
     call.resolve()
   }
 
+  @PluginMethod
+  fun getStats(call: PluginCall) {
+    val id = call.getInt("id")
+    if (id == null) {
+      call.reject("Must provide id")
+      return
+    }
+    call.resolve(JSObject(sdsNative.getStats(id)))
+  }
+
+  @PluginMethod
+  fun resetStats(call: PluginCall) {
+    val id = call.getInt("id")
+    if (id == null) {
+      call.reject("Must provide id")
+      return
+    }
+    sdsNative.resetStats(id)
+    call.resolve()
+  }
+
+  @PluginMethod
+  fun setStatsEnabled(call: PluginCall) {
+    val id = call.getInt("id")
+    val enabled = call.getBoolean("enabled")
+    if (id == null || enabled == null) {
+      call.reject("Must provide id and enabled")
+      return
+    }
+    sdsNative.setStatsEnabled(id, enabled)
+    call.resolve()
+  }
+
+  @PluginMethod
+  fun saveSnapshot(call: PluginCall) {
+    val id = call.getInt("id")
+    val snapshot = call.getString("snapshot")
+    val source = call.getString("source")
+    if (id == null || snapshot == null || source == null) {
+      call.reject("Must provide id, snapshot and source")
+      return
+    }
+    val ret = JSObject()
+    ret.put("saved", sdsNative.saveSnapshot(id, snapshotPath(snapshot), source))
+    call.resolve(ret)
+  }
+
+  @PluginMethod
+  fun loadSnapshot(call: PluginCall) {
+    val id = call.getInt("id")
+    val snapshot = call.getString("snapshot")
+    val source = call.getString("source")
+    if (id == null || snapshot == null || source == null) {
+      call.reject("Must provide id, snapshot and source")
+      return
+    }
+    val ret = JSObject()
+    ret.put("loaded", sdsNative.loadSnapshot(id, snapshotPath(snapshot), source))
+    call.resolve(ret)
+  }
+
+  // Counts tag as a completion the user accepted, which ranks it higher.
+  @PluginMethod
+  fun recordUsage(call: PluginCall) {
+    val id = call.getInt("id")
+    val tag = call.getString("tag")
+    if (id == null || tag == null) {
+      call.reject("Must provide id and tag")
+      return
+    }
+    val ret = JSObject()
+    ret.put("recorded", sdsNative.recordUsage(id, tag))
+    call.resolve(ret)
+  }
+
+  @PluginMethod
+  fun saveUsage(call: PluginCall) {
+    val id = call.getInt("id")
+    val usage = call.getString("usage")
+    if (id == null || usage == null) {
+      call.reject("Must provide id and usage")
+      return
+    }
+    val ret = JSObject()
+    ret.put("saved", sdsNative.saveUsage(id, snapshotPath(usage)))
+    call.resolve(ret)
+  }
+
+  @PluginMethod
+  fun loadUsage(call: PluginCall) {
+    val id = call.getInt("id")
+    val usage = call.getString("usage")
+    if (id == null || usage == null) {
+      call.reject("Must provide id and usage")
+      return
+    }
+    val ret = JSObject()
+    ret.put("loaded", sdsNative.loadUsage(id, snapshotPath(usage)))
+    call.resolve(ret)
+  }
+
+  @PluginMethod
+  fun upsert(call: PluginCall) {
+    val id = call.getInt("id")
+    val word = call.getString("word")
+    if (id == null || word == null) {
+      call.reject("Must provide id and word")
+      return
+    }
+    val category = call.getInt("category") ?: 0
+    val freq = call.getLong("freq") ?: 0L
+    val redirect = call.getString("redirect") ?: "null"
+    val ret = JSObject()
+    ret.put("applied", sdsNative.upsert(id, word, category, freq, redirect))
+    call.resolve(ret)
+  }
+
+  @PluginMethod
+  fun remove(call: PluginCall) {
+    val id = call.getInt("id")
+    val word = call.getString("word")
+    if (id == null || word == null) {
+      call.reject("Must provide id and word")
+      return
+    }
+    val ret = JSObject()
+    ret.put("applied", sdsNative.remove(id, word))
+    call.resolve(ret)
+  }
+
+  // ops is a list of {word, category?, freq?, redirect?, remove?}, applied
+  // in order as one change.
+  @PluginMethod
+  fun batchApply(call: PluginCall) {
+    val id = call.getInt("id")
+    val ops = call.getArray("ops")
+    if (id == null || ops == null) {
+      call.reject("Must provide id and ops")
+      return
+    }
+    val count = ops.length()
+    val removes = BooleanArray(count)
+    val words = arrayOfNulls<String>(count)
+    val categories = IntArray(count)
+    val freqs = LongArray(count)
+    val redirects = arrayOfNulls<String>(count)
+    for (i in 0 until count) {
+      val op = ops.getJSONObject(i)
+      removes[i] = op.optBoolean("remove", false)
+      words[i] = op.getString("word")
+      categories[i] = op.optInt("category", 0)
+      freqs[i] = op.optLong("freq", 0L)
+      redirects[i] = op.optString("redirect", "null")
+    }
+    val ret = JSObject()
+    ret.put("applied", sdsNative.batchApply(id, removes, words, categories, freqs, redirects))
+    call.resolve(ret)
+  }
+
   @PluginMethod
   fun releaseDB(call: PluginCall) {
     val id = call.getInt("id")
@@ -74,4 +397,116 @@ class TagDB : Plugin() {
     sdsNative.releaseDB(id)
     call.resolve()
   }
+
+  @PluginMethod
+  fun createSearchSession(call: PluginCall) {
+    val id = call.getInt("id")
+    if (id == null) {
+      call.reject("Must provide id")
+      return
+    }
+    val sessionId = sdsNative.createSearchSession(id)
+    val ret = JSObject()
+    ret.put("id", sessionId)
+    call.resolve(ret)
+  }
+
+  @PluginMethod
+  fun searchSession(call: PluginCall) {
+    val id = call.getInt("id")
+    val query = call.getString("query")
+    if (id == null || query == null) {
+      call.reject("Must provide id and query")
+      return
+    }
+    val options = searchOptions(call)
+    call.resolve(toResults(searchPacked { sdsNative.searchSessionPacked(id, query, options, it) }))
+  }
+
+  @PluginMethod
+  fun releaseSearchSession(call: PluginCall) {
+    val id = call.getInt("id")
+    if (id == null) {
+      call.reject("Must provide id")
+      return
+    }
+    sdsNative.releaseSearchSession(id)
+    call.resolve()
+  }
+
+  @PluginMethod
+  fun getMemoryUsage(call: PluginCall) {
+    val id = call.getInt("id")
+    if (id == null) {
+      call.reject("Must provide id")
+      return
+    }
+    call.resolve(JSObject(sdsNative.getMemoryUsage(id)))
+  }
+
+  // The "options" object of a call, or null when it has none. Keys left out
+  // stay null and keep the database's values.
+  private fun searchOptions(call: PluginCall): SearchOptions? {
+    val obj = call.getObject("options") ?: return null
+    val options = SearchOptions()
+    if (obj.has("scanBudget")) options.scanBudget = obj.getInt("scanBudget")
+    if (obj.has("resultLimit")) options.resultLimit = obj.getInt("resultLimit")
+    if (obj.has("scoreShortened")) options.scoreShortened = obj.getBoolean("scoreShortened")
+    if (obj.has("timeBudgetMs")) options.timeBudgetMs = obj.getInt("timeBudgetMs")
+    if (obj.has("fuzzyResults")) options.fuzzyResults = obj.getInt("fuzzyResults")
+    if (obj.has("fuzzyEdits")) options.fuzzyEdits = obj.getInt("fuzzyEdits")
+    if (obj.has("fuzzyTimeBudgetMs")) options.fuzzyTimeBudgetMs = obj.getInt("fuzzyTimeBudgetMs")
+    return options
+  }
+
+  private fun snapshotPath(name: String): String {
+    return File(context.filesDir, name).absolutePath
+  }
+
+  @Synchronized
+  private fun searchPacked(search: (ByteBuffer) -> Int): List<JSObject> {
+    val size = search(packBuffer)
+    if (size < 0) {
+      packBuffer = ByteBuffer.allocateDirect(-size).order(ByteOrder.LITTLE_ENDIAN)
+      search(packBuffer)
+    }
+    return toWords(packBuffer)
+  }
+
+  private fun toResults(words: List<JSObject>): JSObject {
+    val ret = JSObject()
+    ret.put("results", JSArray(words))
+    return ret
+  }
+
+  // Reads a result packed as described by PackedLayout in tagdb.hpp.
+  private fun toWords(buffer: ByteBuffer): List<JSObject> {
+    val count = buffer.getInt(0)
+    val freqAt = 8
+    val categoryAt = freqAt + count * 8
+    val priorityAt = categoryAt + count * 4
+    val offsetsAt = priorityAt + count * 4
+    val stringsAt = offsetsAt + (4 * count + 1) * 4
+    val strings = ByteArray(buffer.getInt(4))
+    val view = buffer.duplicate()
+    view.position(stringsAt)
+    view.get(strings)
+    val field = { i: Int ->
+      val start = buffer.getInt(offsetsAt + i * 4)
+      String(strings, start, buffer.getInt(offsetsAt + (i + 1) * 4) - start, Charsets.UTF_8)
+    }
+    val words = ArrayList<JSObject>(count)
+    for (i in 0 until count) {
+      val obj = JSObject()
+      obj.put("normalized", field(4 * i))
+      obj.put("shortened", field(4 * i + 1))
+      obj.put("word", field(4 * i + 2))
+      obj.put("redirect", field(4 * i + 3))
+      obj.put("freq", buffer.getDouble(freqAt + i * 8).toInt())
+      obj.put("priority", buffer.getInt(priorityAt + i * 4))
+      obj.put("category", buffer.getInt(categoryAt + i * 4))
+      words.add(obj)
+    }
+    return words
+  }
 }
@@ -0,0 +1,35 @@
+# Fails the build when a native method of SDSNative, or one the TagDB plugin
+# calls, has no exported Java_ symbol in LIBRARY. A definition that
+# jni_def.h does not declare extern "C" gets a mangled name, which only
+# shows up as an UnsatisfiedLinkError at run time.
+#
+#   cmake -DLIBRARY=libnative.so -DNM=nm -DJAVA=SDSNative.java -DPLUGIN=TagDB.kt -P check_symbols.cmake
+
+file(READ "${JAVA}" java)
+file(READ "${PLUGIN}" plugin)
+string(REGEX MATCHALL "native [A-Za-z\\[\\]]+ [A-Za-z]+\\(" declared "${java}")
+string(REGEX MATCHALL "sdsNative\\.[A-Za-z]+" called "${plugin}")
+set(methods)
+foreach(match ${declared} ${called})
+  string(REGEX REPLACE "^.* |^sdsNative\\.|\\($" "" method "${match}")
+  list(APPEND methods ${method})
+endforeach()
+list(REMOVE_DUPLICATES methods)
+
+execute_process(
+        COMMAND "${NM}" -D --defined-only "${LIBRARY}"
+        OUTPUT_VARIABLE symbols
+        RESULT_VARIABLE result )
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${NM} failed on ${LIBRARY}")
+endif()
+
+set(missing)
+foreach(method ${methods})
+  if(NOT symbols MATCHES " Java_io_sunho_SDStudio_SDSNative_${method}\n")
+    list(APPEND missing ${method})
+  endif()
+endforeach()
+if(missing)
+  message(FATAL_ERROR "no unmangled JNI symbol in ${LIBRARY} for: ${missing}")
+endif()
@@ -4,16 +4,103 @@
 #define ANDROID_JNI_DEF_H
 extern "C" {
 JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_createDB
-        (JNIEnv *, jobject, jstring);
+        (JNIEnv *, jobject, jstring, jobject);
 
 JNIEXPORT jobjectArray JNICALL Java_io_sunho_SDStudio_SDSNative_search
-        (JNIEnv *, jobject, jint, jstring);
+        (JNIEnv *, jobject, jint, jstring, jobject);
+
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_searchPacked
+        (JNIEnv *, jobject, jint, jstring, jobject, jobject);
+
+JNIEXPORT jobjectArray JNICALL Java_io_sunho_SDStudio_SDSNative_lookupBatch
+(JNIEnv *, jobject, jint, jobjectArray);
+
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_searchManyPacked
+(JNIEnv *, jobject, jint, jobjectArray, jint, jobject, jobject, jintArray);
 
 JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_loadDB
 (JNIEnv *, jobject, jint, jstring);
 
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_loadDBWithSnapshot
+(JNIEnv *, jobject, jint, jstring, jstring);
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_loadFile
+(JNIEnv *, jobject, jint, jstring, jstring);
+
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getLoadStats
+(JNIEnv *, jobject, jint);
+
+JNIEXPORT jobjectArray JNICALL Java_io_sunho_SDStudio_SDSNative_getDanglingRedirects
+(JNIEnv *, jobject, jint);
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setLoadThreads
+(JNIEnv *, jobject, jint, jint);
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setSearchThreads
+(JNIEnv *, jobject, jint, jint);
+
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getCacheStats
+(JNIEnv *, jobject, jint);
+
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getSearchOptions
+(JNIEnv *, jobject, jint);
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setSearchOptions
+(JNIEnv *, jobject, jint, jobject);
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setCacheBudget
+(JNIEnv *, jobject, jint, jlong);
+
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getStats
+(JNIEnv *, jobject, jint);
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_resetStats
+(JNIEnv *, jobject, jint);
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setStatsEnabled
+(JNIEnv *, jobject, jint, jboolean);
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_saveSnapshot
+(JNIEnv *, jobject, jint, jstring, jstring);
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_loadSnapshot
+(JNIEnv *, jobject, jint, jstring, jstring);
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_recordUsage
+(JNIEnv *, jobject, jint, jstring);
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_saveUsage
+(JNIEnv *, jobject, jint, jstring);
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_loadUsage
+(JNIEnv *, jobject, jint, jstring);
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_upsert
+(JNIEnv *, jobject, jint, jstring, jint, jlong, jstring);
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_remove
+(JNIEnv *, jobject, jint, jstring);
+
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_batchApply
+(JNIEnv *, jobject, jint, jbooleanArray, jobjectArray, jintArray, jlongArray, jobjectArray);
+
 JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_releaseDB
 (JNIEnv *, jobject, jint);
 
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_createSearchSession
+(JNIEnv *, jobject, jint);
+
+JNIEXPORT jobjectArray JNICALL Java_io_sunho_SDStudio_SDSNative_searchSession
+(JNIEnv *, jobject, jint, jstring, jobject);
+
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_searchSessionPacked
+(JNIEnv *, jobject, jint, jstring, jobject, jobject);
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_releaseSearchSession
+(JNIEnv *, jobject, jint);
+
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getMemoryUsage
+(JNIEnv *, jobject, jint);
+
 }
 #endif //ANDROID_JNI_DEF_H
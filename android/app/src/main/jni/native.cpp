@@ -1,57 +1,557 @@
 #include "jni_def.h"
 
-const int INITIAL_CUTOFF = 1600;
-const int FINAL_CUTOF = 256;
-
 #include "../../../../../src/native/tagdb.hpp"
 
 DatabaseRepository dbRepo;
 
-JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_createDB(JNIEnv *env, jobject, jstring input) {
+// Looked up once in JNI_OnLoad instead of on every search.
+static jclass wordClass;
+static jmethodID wordConstructor;
+static jfieldID scanBudgetField;
+static jfieldID resultLimitField;
+static jfieldID scoreShortenedField;
+static jfieldID timeBudgetMsField;
+static jfieldID fuzzyResultsField;
+static jfieldID fuzzyEditsField;
+static jfieldID fuzzyTimeBudgetMsField;
+static jmethodID intValueMethod;
+static jmethodID booleanValueMethod;
+
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *) {
+    JNIEnv *env;
+    if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK) {
+        return JNI_ERR;
+    }
+    jclass localClass = env->FindClass("io/sunho/SDStudio/Word");
+    wordClass = static_cast<jclass>(env->NewGlobalRef(localClass));
+    env->DeleteLocalRef(localClass);
+    wordConstructor = env->GetMethodID(wordClass, "<init>", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;III)V");
+    jclass optionsClass = env->FindClass("io/sunho/SDStudio/SearchOptions");
+    scanBudgetField = env->GetFieldID(optionsClass, "scanBudget", "Ljava/lang/Integer;");
+    resultLimitField = env->GetFieldID(optionsClass, "resultLimit", "Ljava/lang/Integer;");
+    scoreShortenedField = env->GetFieldID(optionsClass, "scoreShortened", "Ljava/lang/Boolean;");
+    timeBudgetMsField = env->GetFieldID(optionsClass, "timeBudgetMs", "Ljava/lang/Integer;");
+    fuzzyResultsField = env->GetFieldID(optionsClass, "fuzzyResults", "Ljava/lang/Integer;");
+    fuzzyEditsField = env->GetFieldID(optionsClass, "fuzzyEdits", "Ljava/lang/Integer;");
+    fuzzyTimeBudgetMsField = env->GetFieldID(optionsClass, "fuzzyTimeBudgetMs", "Ljava/lang/Integer;");
+    env->DeleteLocalRef(optionsClass);
+    jclass integerClass = env->FindClass("java/lang/Integer");
+    intValueMethod = env->GetMethodID(integerClass, "intValue", "()I");
+    env->DeleteLocalRef(integerClass);
+    jclass booleanClass = env->FindClass("java/lang/Boolean");
+    booleanValueMethod = env->GetMethodID(booleanClass, "booleanValue", "()Z");
+    env->DeleteLocalRef(booleanClass);
+    return JNI_VERSION_1_6;
+}
+
+// Sets value from the boxed field of obj unless the field is null.
+static void readOption(JNIEnv *env, jobject obj, jfieldID field, uint32_t &value) {
+    jobject boxed = env->GetObjectField(obj, field);
+    if (boxed) {
+        value = std::max<jint>(0, env->CallIntMethod(boxed, intValueMethod));
+        env->DeleteLocalRef(boxed);
+    }
+}
+
+static void readOption(JNIEnv *env, jobject obj, jfieldID field, bool &value) {
+    jobject boxed = env->GetObjectField(obj, field);
+    if (boxed) {
+        value = env->CallBooleanMethod(boxed, booleanValueMethod);
+        env->DeleteLocalRef(boxed);
+    }
+}
+
+// base with the non-null fields of a SearchOptions object overridden.
+static SearchOptions toSearchOptions(JNIEnv *env, jobject options, SearchOptions base) {
+    if (options) {
+        readOption(env, options, scanBudgetField, base.scanBudget);
+        readOption(env, options, resultLimitField, base.resultLimit);
+        readOption(env, options, scoreShortenedField, base.scoreShortened);
+        readOption(env, options, timeBudgetMsField, base.timeBudgetMs);
+        readOption(env, options, fuzzyResultsField, base.fuzzyResults);
+        readOption(env, options, fuzzyEditsField, base.fuzzyEdits);
+        readOption(env, options, fuzzyTimeBudgetMsField, base.fuzzyTimeBudgetMs);
+    }
+    return base;
+}
+
+// The options a search given a SearchOptions object runs with, or none
+// when it got null and db's own apply.
+static std::optional<SearchOptions> requestedOptions(JNIEnv *env, jobject options, const Database& db) {
+    if (!options) {
+        return std::nullopt;
+    }
+    return toSearchOptions(env, options, db.searchOptions());
+}
+
+static const SearchOptions *orNull(const std::optional<SearchOptions>& options) {
+    return options ? &*options : nullptr;
+}
+
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_createDB(JNIEnv *env, jobject, jstring input, jobject options) {
     const char *name = env->GetStringUTFChars(input, 0);
-    dbRepo.create(std::string(name));
+    const int id = dbRepo.create(std::string(name), toSearchOptions(env, options, SearchOptions()));
     env->ReleaseStringUTFChars(input, name);
-    return dbRepo.nextId - 1;
+    return id;
 }
 
-JNIEXPORT jobjectArray JNICALL Java_io_sunho_SDStudio_SDSNative_search(JNIEnv *env, jobject, jint id, jstring input) {
-    const char *searchTerm = env->GetStringUTFChars(input, 0);
-    Database& db = dbRepo.get(id);
-    std::vector<Word> result = db.search(searchTerm);
-    env->ReleaseStringUTFChars(input, searchTerm);
+// Throws IllegalArgumentException for an id that is unknown or was released.
+static void throwUnknownId(JNIEnv *env, const char *message) {
+    jclass errorClass = env->FindClass("java/lang/IllegalArgumentException");
+    env->ThrowNew(errorClass, message);
+    env->DeleteLocalRef(errorClass);
+}
 
-    jclass wordClass = env->FindClass("io/sunho/SDStudio/Word");
-    jobjectArray output = env->NewObjectArray(result.size(), wordClass, nullptr);
+// The database with the given id, or null with an exception pending.
+static std::shared_ptr<Database> getDB(JNIEnv *env, jint id) {
+    auto db = dbRepo.get(id);
+    if (!db) {
+        throwUnknownId(env, "Unknown database id");
+    }
+    return db;
+}
 
+static std::string toStdString(JNIEnv *env, jstring input) {
+    const char *chars = env->GetStringUTFChars(input, 0);
+    std::string output(chars);
+    env->ReleaseStringUTFChars(input, chars);
+    return output;
+}
 
-    jmethodID wordConstructor = env->GetMethodID(wordClass, "<init>", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;III)V");
+// Copies a String[] into std::strings.
+static std::vector<std::string> toStdStrings(JNIEnv *env, jobjectArray input) {
+    std::vector<std::string> output(env->GetArrayLength(input));
+    for (size_t i = 0; i < output.size(); i++) {
+        jstring item = static_cast<jstring>(env->GetObjectArrayElement(input, i));
+        output[i] = toStdString(env, item);
+        env->DeleteLocalRef(item);
+    }
+    return output;
+}
 
-    for (size_t i = 0; i < result.size(); i++) {
-        jstring normalized = env->NewStringUTF(utf16ToUtf8(result[i].normalized).c_str());
-        jstring shortened = env->NewStringUTF(utf16ToUtf8(result[i].shortened).c_str());
-        jstring word = env->NewStringUTF(utf16ToUtf8(result[i].word).c_str());
-        jstring redirect = env->NewStringUTF(utf16ToUtf8(result[i].redirect).c_str());
+static jobject toWord(JNIEnv *env, const TagStore& store, const Word& item) {
+    const WordText text = store.getText(item.id);
+    jstring normalized = env->NewStringUTF(std::string(text.normalized).c_str());
+    jstring shortened = env->NewStringUTF(std::string(text.shortened).c_str());
+    jstring word = env->NewStringUTF(std::string(text.word).c_str());
+    jstring redirect = env->NewStringUTF(std::string(text.redirect).c_str());
 
-        jobject wordObj = env->NewObject(wordClass, wordConstructor, normalized, shortened, word, redirect, result[i].freq, result[i].priority, result[i].category);
-        env->SetObjectArrayElement(output, i, wordObj);
+    jobject wordObj = env->NewObject(wordClass, wordConstructor, normalized, shortened, word, redirect, jint(item.freq), jint(item.priority), jint(item.category));
 
-        env->DeleteLocalRef(normalized);
-        env->DeleteLocalRef(shortened);
-        env->DeleteLocalRef(word);
-        env->DeleteLocalRef(redirect);
+    env->DeleteLocalRef(normalized);
+    env->DeleteLocalRef(shortened);
+    env->DeleteLocalRef(word);
+    env->DeleteLocalRef(redirect);
+    return wordObj;
+}
+
+static jobjectArray toWordArray(JNIEnv *env, const TagStore& store, const std::vector<Word>& result) {
+    jobjectArray output = env->NewObjectArray(result.size(), wordClass, nullptr);
+
+    for (size_t i = 0; i < result.size(); i++) {
+        jobject wordObj = toWord(env, store, result[i]);
+        env->SetObjectArrayElement(output, i, wordObj);
         env->DeleteLocalRef(wordObj);
     }
 
     return output;
 }
 
+// Runs convert, which turns search results into Java values, and records
+// the time it took as the marshal phase of db's search stats.
+template <class Convert>
+static auto marshal(const Database& db, Convert convert) {
+    const auto stats = db.searchStats();
+    PhaseTimer timer(stats->enabled() ? stats.get() : nullptr);
+    auto value = convert();
+    timer.lap(SearchPhase::Marshal);
+    return value;
+}
+
+// Packs result into the direct buffer out (see PackedLayout) and returns the
+// packed size. When out is too small nothing is written and the size needed
+// is returned negated.
+static jint packInto(JNIEnv *env, const TagStore& store, const std::vector<Word>& result, jobject out) {
+    const size_t size = store.packedSize(result);
+    if (size > size_t(env->GetDirectBufferCapacity(out))) {
+        return -jint(size);
+    }
+    store.pack(result, static_cast<char *>(env->GetDirectBufferAddress(out)));
+    return size;
+}
+
+// The null fields of options keep the database's search options; a null
+// options object is the same as all fields null.
+JNIEXPORT jobjectArray JNICALL Java_io_sunho_SDStudio_SDSNative_search(JNIEnv *env, jobject, jint id, jstring input, jobject options) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return nullptr;
+    }
+    const auto requested = requestedOptions(env, options, *db);
+    const char *searchTerm = env->GetStringUTFChars(input, 0);
+    const auto store = db->current();
+    std::vector<Word> result = db->search(*store, searchTerm, nullptr, orNull(requested));
+    env->ReleaseStringUTFChars(input, searchTerm);
+    return marshal(*db, [&] { return toWordArray(env, *store, result); });
+}
+
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_searchPacked(JNIEnv *env, jobject, jint id, jstring input, jobject options, jobject out) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return 0;
+    }
+    const auto requested = requestedOptions(env, options, *db);
+    const char *searchTerm = env->GetStringUTFChars(input, 0);
+    const auto store = db->current();
+    std::vector<Word> result = db->search(*store, searchTerm, nullptr, orNull(requested));
+    env->ReleaseStringUTFChars(input, searchTerm);
+    return marshal(*db, [&] { return packInto(env, *store, result, out); });
+}
+
+// The row of each tag, or null when the tag is not loaded.
+JNIEXPORT jobjectArray JNICALL Java_io_sunho_SDStudio_SDSNative_lookupBatch(JNIEnv *env, jobject, jint id, jobjectArray input) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return nullptr;
+    }
+    const std::vector<std::string> tags = toStdStrings(env, input);
+    const auto store = db->current();
+    const std::vector<uint32_t> rows = store->lookupBatch(tags);
+    jobjectArray output = env->NewObjectArray(rows.size(), wordClass, nullptr);
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (rows[i] == TagStore::NO_ROW) {
+            continue;
+        }
+        jobject wordObj = toWord(env, *store, store->getWord(rows[i]));
+        env->SetObjectArrayElement(output, i, wordObj);
+        env->DeleteLocalRef(wordObj);
+    }
+    return output;
+}
+
+// Packs the best k rows of every query into out as searchPacked does, and
+// fills queryOffsets with queries.length + 1 entries delimiting each query's
+// rows.
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_searchManyPacked(JNIEnv *env, jobject, jint id, jobjectArray input, jint k, jobject options, jobject out, jintArray queryOffsets) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return 0;
+    }
+    const std::vector<std::string> queries = toStdStrings(env, input);
+    const auto store = db->current();
+    SearchOptions used = toSearchOptions(env, options, db->searchOptions());
+    used.resultLimit = std::max(0, k);
+    std::vector<uint32_t> offsets;
+    const std::vector<Word> joined = joinResults(store->searchMany(queries, used), offsets);
+    std::vector<jint> values(offsets.begin(), offsets.end());
+    env->SetIntArrayRegion(queryOffsets, 0, values.size(), values.data());
+    return marshal(*db, [&] { return packInto(env, *store, joined, out); });
+}
+
 JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_loadDB(JNIEnv *env, jobject, jint id, jstring input) {
-    const char *path = env->GetStringUTFChars(input, 0);
-    Database& db = dbRepo.get(id);
-    db.load(std::string(path));
-    env->ReleaseStringUTFChars(input, path);
+    const auto db = getDB(env, id);
+    if (!db) {
+        return;
+    }
+    const char *csv = env->GetStringUTFChars(input, 0);
+    db->load(std::string(csv));
+    env->ReleaseStringUTFChars(input, csv);
+}
+
+// Blocks until the whole file is loaded; searches from other threads see
+// the rows loaded so far. snapshotPath may be null.
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_loadFile(JNIEnv *env, jobject, jint id, jstring path, jstring snapshotPath) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return JNI_FALSE;
+    }
+    const char *file = env->GetStringUTFChars(path, 0);
+    std::string snapshot;
+    if (snapshotPath) {
+        const char *chars = env->GetStringUTFChars(snapshotPath, 0);
+        snapshot = chars;
+        env->ReleaseStringUTFChars(snapshotPath, chars);
+    }
+    const bool loaded = db->loadFile(std::string(file), snapshot);
+    env->ReleaseStringUTFChars(path, file);
+    return loaded;
+}
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_loadDBWithSnapshot(JNIEnv *env, jobject, jint id, jstring input, jstring snapshotPath) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return;
+    }
+    const char *csv = env->GetStringUTFChars(input, 0);
+    const char *path = env->GetStringUTFChars(snapshotPath, 0);
+    db->loadWithSnapshot(std::string(csv), std::string(path));
+    env->ReleaseStringUTFChars(snapshotPath, path);
+    env->ReleaseStringUTFChars(input, csv);
+}
+
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getLoadStats(JNIEnv *env, jobject, jint id) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return nullptr;
+    }
+    return env->NewStringUTF(toJson(db->loadStats().fields()).c_str());
+}
+
+JNIEXPORT jobjectArray JNICALL Java_io_sunho_SDStudio_SDSNative_getDanglingRedirects(JNIEnv *env, jobject, jint id) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return nullptr;
+    }
+    const auto store = db->current();
+    const std::vector<std::string_view> targets = store->danglingRedirects();
+    jclass stringClass = env->FindClass("java/lang/String");
+    jobjectArray output = env->NewObjectArray(targets.size(), stringClass, nullptr);
+    for (size_t i = 0; i < targets.size(); i++) {
+        jstring target = env->NewStringUTF(std::string(targets[i]).c_str());
+        env->SetObjectArrayElement(output, i, target);
+        env->DeleteLocalRef(target);
+    }
+    env->DeleteLocalRef(stringClass);
+    return output;
+}
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setLoadThreads(JNIEnv *env, jobject, jint id, jint threads) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return;
+    }
+    db->loadThreads = threads;
+}
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setSearchThreads(JNIEnv *env, jobject, jint id, jint threads) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return;
+    }
+    db->setSearchThreads(threads);
+}
+
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getCacheStats(JNIEnv *env, jobject, jint id) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return nullptr;
+    }
+    return env->NewStringUTF(toJson(db->cacheStats().fields()).c_str());
+}
+
+// Search counters and per-phase timings as JSON, see SearchStats::json().
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getStats(JNIEnv *env, jobject, jint id) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return nullptr;
+    }
+    return env->NewStringUTF(db->searchStats()->json().c_str());
+}
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_resetStats(JNIEnv *env, jobject, jint id) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return;
+    }
+    db->searchStats()->reset();
+}
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setStatsEnabled(JNIEnv *env, jobject, jint id, jboolean enabled) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return;
+    }
+    db->searchStats()->setEnabled(enabled);
+}
+
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getSearchOptions(JNIEnv *env, jobject, jint id) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return nullptr;
+    }
+    return env->NewStringUTF(toJson(db->searchOptions().fields()).c_str());
+}
+
+// Changes the non-null fields of options; the others keep their values.
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setSearchOptions(JNIEnv *env, jobject, jint id, jobject options) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return;
+    }
+    db->setSearchOptions(toSearchOptions(env, options, db->searchOptions()));
+}
+
+// A budget of 0 turns the query cache off.
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_setCacheBudget(JNIEnv *env, jobject, jint id, jlong bytes) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return;
+    }
+    db->setCacheBudget(std::max<jlong>(0, bytes));
+}
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_saveSnapshot(JNIEnv *env, jobject, jint id, jstring snapshotPath, jstring source) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return false;
+    }
+    const char *path = env->GetStringUTFChars(snapshotPath, 0);
+    const char *content = env->GetStringUTFChars(source, 0);
+    bool saved = db->saveSnapshot(std::string(path), sourceHash(std::string(content)));
+    env->ReleaseStringUTFChars(source, content);
+    env->ReleaseStringUTFChars(snapshotPath, path);
+    return saved;
+}
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_loadSnapshot(JNIEnv *env, jobject, jint id, jstring snapshotPath, jstring source) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return false;
+    }
+    const char *path = env->GetStringUTFChars(snapshotPath, 0);
+    const char *content = env->GetStringUTFChars(source, 0);
+    bool loaded = db->loadSnapshot(std::string(path), sourceHash(std::string(content)));
+    env->ReleaseStringUTFChars(source, content);
+    env->ReleaseStringUTFChars(snapshotPath, path);
+    return loaded;
+}
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_recordUsage(JNIEnv *env, jobject, jint id, jstring tag) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return false;
+    }
+    const char *chars = env->GetStringUTFChars(tag, 0);
+    bool recorded = db->recordUsage(std::string(chars));
+    env->ReleaseStringUTFChars(tag, chars);
+    return recorded;
+}
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_saveUsage(JNIEnv *env, jobject, jint id, jstring usagePath) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return false;
+    }
+    const char *path = env->GetStringUTFChars(usagePath, 0);
+    bool saved = db->saveUsage(std::string(path));
+    env->ReleaseStringUTFChars(usagePath, path);
+    return saved;
+}
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_loadUsage(JNIEnv *env, jobject, jint id, jstring usagePath) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return false;
+    }
+    const char *path = env->GetStringUTFChars(usagePath, 0);
+    bool loaded = db->loadUsage(std::string(path));
+    env->ReleaseStringUTFChars(usagePath, path);
+    return loaded;
+}
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_upsert(JNIEnv *env, jobject, jint id, jstring word, jint category, jlong freq, jstring redirect) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return false;
+    }
+    TagUpdate update;
+    update.word = toStdString(env, word);
+    update.category = category;
+    update.freq = freq;
+    update.redirect = toStdString(env, redirect);
+    return db->upsert(update);
+}
+
+JNIEXPORT jboolean JNICALL Java_io_sunho_SDStudio_SDSNative_remove(JNIEnv *env, jobject, jint id, jstring word) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return false;
+    }
+    return db->remove(toStdString(env, word));
+}
+
+// The updates come as parallel arrays, one entry per update.
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_batchApply(JNIEnv *env, jobject, jint id, jbooleanArray removes, jobjectArray words, jintArray categories, jlongArray freqs, jobjectArray redirects) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return 0;
+    }
+    const jsize count = env->GetArrayLength(words);
+    std::vector<jboolean> removeValues(count);
+    std::vector<jint> categoryValues(count);
+    std::vector<jlong> freqValues(count);
+    env->GetBooleanArrayRegion(removes, 0, count, removeValues.data());
+    env->GetIntArrayRegion(categories, 0, count, categoryValues.data());
+    env->GetLongArrayRegion(freqs, 0, count, freqValues.data());
+    std::vector<TagUpdate> updates(count);
+    for (jsize i = 0; i < count; i++) {
+        jstring word = static_cast<jstring>(env->GetObjectArrayElement(words, i));
+        jstring redirect = static_cast<jstring>(env->GetObjectArrayElement(redirects, i));
+        updates[i].remove = removeValues[i];
+        updates[i].word = toStdString(env, word);
+        updates[i].category = categoryValues[i];
+        updates[i].freq = freqValues[i];
+        updates[i].redirect = toStdString(env, redirect);
+        env->DeleteLocalRef(word);
+        env->DeleteLocalRef(redirect);
+    }
+    return db->batchApply(updates);
 }
 
 JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_releaseDB(JNIEnv *env, jobject, jint id) {
-    dbRepo.release(id);
+    if (!dbRepo.release(id)) {
+        throwUnknownId(env, "Unknown database id");
+    }
+}
+
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_createSearchSession(JNIEnv *env, jobject, jint id) {
+    const int sessionId = dbRepo.createSession(id);
+    if (sessionId < 0) {
+        throwUnknownId(env, "Unknown database id");
+    }
+    return sessionId;
+}
+
+JNIEXPORT jobjectArray JNICALL Java_io_sunho_SDStudio_SDSNative_searchSession(JNIEnv *env, jobject, jint id, jstring input, jobject options) {
+    const auto session = dbRepo.getSession(id);
+    const auto db = session ? dbRepo.get(session->dbId) : nullptr;
+    if (!db) {
+        throwUnknownId(env, "Unknown search session id");
+        return nullptr;
+    }
+    const auto requested = requestedOptions(env, options, *db);
+    const char *searchTerm = env->GetStringUTFChars(input, 0);
+    const auto store = db->current();
+    std::vector<Word> result = session->search(*db, *store, searchTerm, nullptr, orNull(requested));
+    env->ReleaseStringUTFChars(input, searchTerm);
+    return marshal(*db, [&] { return toWordArray(env, *store, result); });
+}
+
+JNIEXPORT jint JNICALL Java_io_sunho_SDStudio_SDSNative_searchSessionPacked(JNIEnv *env, jobject, jint id, jstring input, jobject options, jobject out) {
+    const auto session = dbRepo.getSession(id);
+    const auto db = session ? dbRepo.get(session->dbId) : nullptr;
+    if (!db) {
+        throwUnknownId(env, "Unknown search session id");
+        return 0;
+    }
+    const auto requested = requestedOptions(env, options, *db);
+    const char *searchTerm = env->GetStringUTFChars(input, 0);
+    const auto store = db->current();
+    std::vector<Word> result = session->search(*db, *store, searchTerm, nullptr, orNull(requested));
+    env->ReleaseStringUTFChars(input, searchTerm);
+    return marshal(*db, [&] { return packInto(env, *store, result, out); });
+}
+
+JNIEXPORT void JNICALL Java_io_sunho_SDStudio_SDSNative_releaseSearchSession(JNIEnv *env, jobject, jint id) {
+    if (!dbRepo.releaseSession(id)) {
+        throwUnknownId(env, "Unknown search session id");
+    }
+}
+
+JNIEXPORT jstring JNICALL Java_io_sunho_SDStudio_SDSNative_getMemoryUsage(JNIEnv *env, jobject, jint id) {
+    const auto db = getDB(env, id);
+    if (!db) {
+        return nullptr;
+    }
+    return env->NewStringUTF(toJson(db->memoryUsage().fields()).c_str());
 }
@@ -39,6 +39,15 @@ import contextMenu from 'electron-context-menu';
 import * as electronDL from 'electron-dl';
 import { createGzip } from 'zlib';
 import { ImageOptimizeMethod } from '../renderer/backend';
+import { exactWordTag } from '../renderer/models/Tags';
+import {
+  PIECES_CACHE_BYTES,
+  PIECES_DB_OPTIONS,
+  TAG_CACHE_BYTES,
+  USAGE_FILE,
+  debounceUsageSave,
+  diffPieces,
+} from '../renderer/backends/tagDBCommon';
 
 interface DataBaseConns {
   tagDBId: number;
@@ -50,8 +59,12 @@ let databases: DataBaseConns = {
   pieceDBId: -1,
 };
 
+// Settles once the tag file is fully loaded. Searches run over the rows
+// loaded so far, but lookups wait so that a tag is never reported unknown
+// only because its row is still to come.
+let tagDBLoaded: Promise<unknown> = Promise.resolve();
+
 let mainWindow: BrowserWindow | null = null;
-let tagMap: Map<string, any> = new Map();
 
 async function listFilesInDirectory(dir: any) {
   try {
@@ -183,20 +196,35 @@ ipcMain.handle('unzip-files', async (event, zipPath, outPath) => {
 });
 
 ipcMain.handle('search-tags', async (event, word) => {
-  return native.search(databases.tagDBId, word);
+  // Packed results go over IPC as one buffer and are unpacked by the
+  // renderer. Null when a newer search-tags call superseded this one.
+  return await native.searchAsync(
+    databases.tagDBId,
+    word,
+    'search-tags',
+    true,
+  );
+});
+
+ipcMain.handle('search-tags-many', (event, words, k) => {
+  return native.searchMany(databases.tagDBId, words, k);
 });
 
+let loadedPieces = new Set<string>();
+
 ipcMain.handle('load-pieces-db', async (event, pieces) => {
-  const csv = pieces
-    .map((x: string) => {
-      return `<${x}>,0,0,null`;
-    })
-    .join('\n');
-  native.loadDB(databases.pieceDBId, csv);
+  const { ops, words } = diffPieces(loadedPieces, pieces);
+  native.batchApply(databases.pieceDBId, ops);
+  loadedPieces = words;
 });
 
 ipcMain.handle('search-pieces', async (event, word) => {
-  return native.search(databases.pieceDBId, word);
+  return await native.searchAsync(
+    databases.pieceDBId,
+    word,
+    'search-pieces',
+    true,
+  );
 });
 
 ipcMain.handle('list-files', async (event, arg) => {
@@ -591,8 +619,22 @@ ipcMain.handle('extract-zip', async (event, zipPath, outPath) => {
   }
 });
 
-ipcMain.handle('lookup-tag', (event, word) => {
-  return tagMap.get(word);
+ipcMain.handle('lookup-tag', async (event, word) => {
+  await tagDBLoaded;
+  return exactWordTag(word, native.lookupBatch(databases.tagDBId, [word])[0]);
+});
+
+ipcMain.handle('lookup-tags', async (event, words) => {
+  await tagDBLoaded;
+  return native.lookupBatch(databases.tagDBId, words);
+});
+
+const saveTagUsage = debounceUsageSave(() =>
+  native.saveUsage(databases.tagDBId, path.join(DEFAULT_APP_DIR, USAGE_FILE)),
+);
+
+ipcMain.handle('record-tag-usage', (event, word) => {
+  if (native.recordUsage(databases.tagDBId, word)) saveTagUsage();
 });
 
 let localAIRunning = false;
@@ -855,22 +897,24 @@ async function init() {
       await fs.readFile(path.join(DEFAULT_APP_DIR, 'config.json'), 'utf-8'),
     );
   } catch (e) {}
-  const dbCsvContent = await fs.readFile(path.join(dataDir, 'db.csv'), 'utf-8');
-  databases.tagDBId = native.createDB('danbooru');
-  native.loadDB(databases.tagDBId, dbCsvContent);
-  databases.pieceDBId = native.createDB('pieces');
-  dbCsvContent.split('\n').forEach((x: string) => {
-    const comps: string[] = x.split(',');
-    if (comps.length !== 4) return;
-    tagMap.set(comps[0], {
-      word: comps[0],
-      normalized: comps[0],
-      freq: parseInt(comps[2]),
-      category: parseInt(comps[1]),
-      redirect: comps[3],
-      priority: 0,
+  // Typos get a fuzzy fallback when they leave few results.
+  databases.tagDBId = native.createDB('danbooru', { fuzzyResults: 8 });
+  native.setSearchThreads(databases.tagDBId, Math.min(4, os.cpus().length));
+  native.loadUsage(databases.tagDBId, path.join(DEFAULT_APP_DIR, USAGE_FILE));
+  // Not awaited: tag searches are answered over the rows loaded so far
+  // while the rest of the file is parsed.
+  tagDBLoaded = native
+    .loadFile(
+      databases.tagDBId,
+      path.join(dataDir, 'db.csv'),
+      path.join(DEFAULT_APP_DIR, 'tags.snapshot'),
+    )
+    .then((loaded: boolean) => {
+      if (!loaded) console.error('Could not read the tag database');
     });
-  });
+  databases.pieceDBId = native.createDB('pieces', PIECES_DB_OPTIONS);
+  native.setCacheBudget(databases.tagDBId, TAG_CACHE_BYTES);
+  native.setCacheBudget(databases.pieceDBId, PIECES_CACHE_BYTES);
   await initFolder();
 }
 
@@ -22,6 +22,7 @@ export type Channels =
   | 'get-version'
   | 'open-web-page'
   | 'search-tags'
+  | 'search-tags-many'
   | 'load-pieces-db'
   | 'get-config'
   | 'set-config'
@@ -44,7 +45,9 @@ export type Channels =
   | 'select-file'
   | 'get-remain-credits'
   | 'copy-image-to-clipboard'
-  | 'lookup-tag';
+  | 'lookup-tag'
+  | 'lookup-tags'
+  | 'record-tag-usage';
 
 const electronHandler = {
   ipcRenderer: {
@@ -0,0 +1,33 @@
+// Compares returning search results as one object per row (search) with the
+// packed buffer (searchPacked) decoded on the JS side, for the same queries.
+const { createDB, loadDB, search, searchPacked } = require('./');
+const fs = require('fs');
+// The renderer's own decoder, so that the numbers follow any change to it.
+require('ts-node/register/transpile-only');
+const { unpackWords } = require('../renderer/backends/packedWords');
+
+function measure(name, queries, rounds, fn) {
+  for (const query of queries) fn(query);
+  const before = process.hrtime.bigint();
+  let rows = 0;
+  for (let i = 0; i < rounds; i++) {
+    for (const query of queries) rows += fn(query);
+  }
+  const after = process.hrtime.bigint();
+  const perQuery = Number(after - before) / 1000 / (rounds * queries.length);
+  console.log(`${name}: ${perQuery.toFixed(1)} us/query, ${rows} rows`);
+}
+
+const db = createDB('bench');
+loadDB(db, fs.readFileSync('db.csv', 'utf8'));
+const queries = ['1', 'a', 'ha', 'blue', 'hair', 'ㄱ', '하', 'girl', 'sky'];
+const rounds = 50;
+
+measure('objects', queries, rounds, (q) => search(db, q).length);
+measure('packed', queries, rounds, (q) => searchPacked(db, q).count);
+measure(
+  'packed + unpack',
+  queries,
+  rounds,
+  (q) => unpackWords(searchPacked(db, q)).length,
+);
@@ -0,0 +1,415 @@
+// Standalone benchmark for tagdb.hpp. Loads db.csv, replays the query
+// corpora in queries/ (one query per line, one corpus per file) and reports
+// load time, search latency percentiles, the time spent in each search phase
+// and peak RSS, then how close the default search budgets come to an
+// unbounded scan with the rows in file order and in frequency order.
+//
+//   cmake -S src/native/bench -B src/native/bench/build
+//   cmake --build src/native/bench/build
+//   src/native/bench/build/tagdb_bench [--csv path] [--queries dir]
+//       [--rounds n] [--threads n] [--label name] [--json path]
+//
+// --json also writes the numbers as one JSON object, so runs on different
+// commits can be compared. Searches go to the TagStore directly, bypassing
+// the query cache, so every round measures the full search.
+
+#include "tagdb.hpp"
+
+#include <filesystem>
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+struct Options {
+  std::string csv = TAGDB_BENCH_CSV;
+  std::string queries = TAGDB_BENCH_QUERIES;
+  std::string label;
+  std::string json;
+  size_t rounds = 20;
+  size_t threads = 1;
+};
+
+struct Corpus {
+  std::string name;
+  std::vector<std::string> queries;
+};
+
+// One timed search.
+struct Sample {
+  uint64_t normalizeNs = 0;
+  uint64_t collectNs = 0;
+  uint64_t rankNs = 0;
+  size_t candidates = 0;
+  size_t results = 0;
+
+  uint64_t totalNs() const {
+    return normalizeNs + collectNs + rankNs;
+  }
+};
+
+struct Summary {
+  size_t queries = 0;
+  std::vector<Sample> samples;
+
+  // Nearest-rank percentile of the total latency, in microseconds.
+  double percentileUs(std::vector<uint64_t>& sorted, double p) const {
+    if (sorted.empty()) {
+      return 0;
+    }
+    const size_t rank = std::min(sorted.size() - 1, size_t(p / 100 * sorted.size()));
+    return sorted[rank] / 1e3;
+  }
+
+  std::vector<std::pair<std::string, double>> fields() const {
+    std::vector<uint64_t> totals;
+    totals.reserve(samples.size());
+    double normalizeNs = 0, collectNs = 0, rankNs = 0, candidates = 0, results = 0;
+    for (const auto& sample : samples) {
+      totals.push_back(sample.totalNs());
+      normalizeNs += sample.normalizeNs;
+      collectNs += sample.collectNs;
+      rankNs += sample.rankNs;
+      candidates += sample.candidates;
+      results += sample.results;
+    }
+    std::sort(totals.begin(), totals.end());
+    const double count = std::max<size_t>(1, samples.size());
+    const double totalNs = normalizeNs + collectNs + rankNs;
+    return {
+      {"queries", double(queries)},
+      {"samples", double(samples.size())},
+      {"meanUs", totalNs / count / 1e3},
+      {"p50Us", percentileUs(totals, 50)},
+      {"p95Us", percentileUs(totals, 95)},
+      {"p99Us", percentileUs(totals, 99)},
+      {"maxUs", totals.empty() ? 0 : totals.back() / 1e3},
+      {"normalizeUs", normalizeNs / count / 1e3},
+      {"collectUs", collectNs / count / 1e3},
+      {"rankUs", rankNs / count / 1e3},
+      {"candidates", candidates / count},
+      {"results", results / count},
+    };
+  }
+};
+
+uint64_t elapsedNs(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+size_t peakRssBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool readFile(const std::string& path, std::string& out) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  out = buffer.str();
+  return true;
+}
+
+// Every *.txt file of dir, in name order. Blank lines are skipped.
+std::vector<Corpus> readCorpora(const std::string& dir) {
+  std::vector<std::filesystem::path> paths;
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".txt") {
+      paths.push_back(entry.path());
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  std::vector<Corpus> corpora;
+  for (const auto& path : paths) {
+    Corpus corpus{path.stem().string(), {}};
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (!line.empty()) {
+        corpus.queries.push_back(line);
+      }
+    }
+    corpora.push_back(std::move(corpus));
+  }
+  return corpora;
+}
+
+// The phases of TagStore::search, timed one by one.
+Sample runQuery(const TagStore& store, const std::string& query, ThreadPool* pool) {
+  Sample sample;
+  const auto start = std::chrono::steady_clock::now();
+  const std::u16string normalized = normalizeUtf16(query);
+  const auto normalizedAt = std::chrono::steady_clock::now();
+  std::vector<uint32_t> ids;
+  store.collect(normalized, 0, ids, nullptr, pool);
+  const auto collectedAt = std::chrono::steady_clock::now();
+  const std::vector<Word> result = store.rank(normalized, ids, pool);
+  const auto rankedAt = std::chrono::steady_clock::now();
+  sample.normalizeNs = elapsedNs(start, normalizedAt);
+  sample.collectNs = elapsedNs(normalizedAt, collectedAt);
+  sample.rankNs = elapsedNs(collectedAt, rankedAt);
+  sample.candidates = ids.size();
+  sample.results = result.size();
+  return sample;
+}
+
+// Results under the default budgets against an unbounded scan, over the
+// queries of one corpus.
+struct Quality {
+  size_t queries = 0;
+  // Queries whose results equal the unbounded ones.
+  size_t exact = 0;
+  // Sum over queries of the share of the unbounded top 10 that made the top
+  // 10.
+  double recall10 = 0;
+  uint64_t rowsScanned = 0;
+  uint64_t unboundedRowsScanned = 0;
+
+  Quality& operator+=(const Quality& other) {
+    queries += other.queries;
+    exact += other.exact;
+    recall10 += other.recall10;
+    rowsScanned += other.rowsScanned;
+    unboundedRowsScanned += other.unboundedRowsScanned;
+    return *this;
+  }
+
+  std::vector<std::pair<std::string, double>> fields() const {
+    const double count = std::max<size_t>(1, queries);
+    return {
+      {"queries", double(queries)},
+      {"exact", exact / count},
+      {"recall10", recall10 / count},
+      {"rowsScanned", rowsScanned / count},
+      {"unboundedRowsScanned", unboundedRowsScanned / count},
+    };
+  }
+};
+
+std::vector<Word> searchCounted(const TagStore& store, const std::u16string& query, const SearchOptions& options, uint64_t& rowsScanned) {
+  SearchCounters counters;
+  std::vector<uint32_t> ids;
+  store.collect(query, 0, ids, nullptr, nullptr, options, &counters);
+  rowsScanned += counters.rowsScanned;
+  return store.rank(query, ids, nullptr, options);
+}
+
+Quality measureQuality(const TagStore& store, const std::vector<std::string>& queries) {
+  SearchOptions unbounded;
+  unbounded.scanBudget = UINT32_MAX;
+  Quality quality;
+  for (const auto& query : queries) {
+    const std::u16string normalized = normalizeUtf16(query);
+    const std::vector<Word> found = searchCounted(store, normalized, SearchOptions(), quality.rowsScanned);
+    const std::vector<Word> best = searchCounted(store, normalized, unbounded, quality.unboundedRowsScanned);
+    quality.queries++;
+    quality.exact += std::equal(found.begin(), found.end(), best.begin(), best.end(), [](const Word& a, const Word& b) { return a.word == b.word; });
+    // By word, as an alias and its canonical row may both be listed.
+    std::set<std::u16string_view> top, kept;
+    for (size_t i = 0; i < std::min<size_t>(10, best.size()); i++) {
+      top.insert(best[i].word);
+    }
+    for (size_t i = 0; i < std::min<size_t>(10, found.size()); i++) {
+      if (top.count(found[i].word)) {
+        kept.insert(found[i].word);
+      }
+    }
+    quality.recall10 += top.empty() ? 1 : double(kept.size()) / top.size();
+  }
+  return quality;
+}
+
+std::string quoted(const std::string& text) {
+  std::string out = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+    }
+    out.push_back(c);
+  }
+  return out + "\"";
+}
+
+void printRow(const std::string& name, const Summary& summary) {
+  const auto fields = summary.fields();
+  std::map<std::string, double> value(fields.begin(), fields.end());
+  std::cout << std::left << std::setw(14) << name << std::right << std::setw(6) << size_t(value["queries"])
+            << std::fixed << std::setprecision(1) << std::setw(10) << value["p50Us"] << std::setw(10) << value["p95Us"]
+            << std::setw(10) << value["p99Us"] << std::setw(10) << value["maxUs"] << std::setw(10) << value["normalizeUs"]
+            << std::setw(10) << value["collectUs"] << std::setw(10) << value["rankUs"] << std::setw(10) << value["candidates"]
+            << "\n";
+}
+
+void printQualityRow(const std::string& name, const Quality& file, const Quality& frequency) {
+  std::cout << std::left << std::setw(14) << name << std::right << std::setw(6) << file.queries;
+  for (const Quality* quality : {&file, &frequency}) {
+    const auto fields = quality->fields();
+    std::map<std::string, double> value(fields.begin(), fields.end());
+    std::cout << std::fixed << std::setprecision(3) << std::setw(10) << value["exact"] << std::setw(10) << value["recall10"]
+              << std::setprecision(0) << std::setw(10) << value["rowsScanned"] << std::setw(10) << value["unboundedRowsScanned"];
+  }
+  std::cout << "\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << "\n";
+      return false;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--csv") {
+      options.csv = value;
+    } else if (arg == "--queries") {
+      options.queries = value;
+    } else if (arg == "--label") {
+      options.label = value;
+    } else if (arg == "--json") {
+      options.json = value;
+    } else if (arg == "--rounds") {
+      options.rounds = std::max(1, std::stoi(value));
+    } else if (arg == "--threads") {
+      options.threads = std::max(1, std::stoi(value));
+    } else {
+      std::cerr << "Unknown option " << arg << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    std::cerr << "Usage: tagdb_bench [--csv path] [--queries dir] [--rounds n] [--threads n] [--label name] [--json path]\n";
+    return 2;
+  }
+  std::string csv;
+  if (!readFile(options.csv, csv)) {
+    std::cerr << "Cannot read " << options.csv << "\n";
+    return 1;
+  }
+  const std::vector<Corpus> corpora = readCorpora(options.queries);
+  if (corpora.empty()) {
+    std::cerr << "No query corpora in " << options.queries << "\n";
+    return 1;
+  }
+
+  Database db("bench");
+  db.setSearchThreads(options.threads);
+  const auto loadStart = std::chrono::steady_clock::now();
+  db.load(csv);
+  const double loadMs = elapsedNs(loadStart, std::chrono::steady_clock::now()) / 1e6;
+  const auto store = db.current();
+  const auto pool = db.searchPool();
+
+  // One untimed pass warms the caches and the thread pool.
+  for (const auto& corpus : corpora) {
+    for (const auto& query : corpus.queries) {
+      runQuery(*store, query, pool.get());
+    }
+  }
+  std::vector<Summary> summaries(corpora.size());
+  Summary all;
+  for (size_t round = 0; round < options.rounds; round++) {
+    for (size_t c = 0; c < corpora.size(); c++) {
+      for (const auto& query : corpora[c].queries) {
+        summaries[c].samples.push_back(runQuery(*store, query, pool.get()));
+      }
+    }
+  }
+  for (size_t c = 0; c < corpora.size(); c++) {
+    summaries[c].queries = corpora[c].queries.size();
+    all.queries += summaries[c].queries;
+    all.samples.insert(all.samples.end(), summaries[c].samples.begin(), summaries[c].samples.end());
+  }
+  const size_t peakRss = peakRssBytes();
+
+  std::cout << "rows " << store->size() << ", load " << std::fixed << std::setprecision(1) << loadMs << " ms, "
+            << options.rounds << " rounds, " << options.threads << " search threads, peak RSS "
+            << peakRss / (1024.0 * 1024.0) << " MiB\n\n";
+  std::cout << std::left << std::setw(14) << "corpus" << std::right << std::setw(6) << "n" << std::setw(10) << "p50 us"
+            << std::setw(10) << "p95 us" << std::setw(10) << "p99 us" << std::setw(10) << "max us" << std::setw(10) << "norm us"
+            << std::setw(10) << "coll us" << std::setw(10) << "rank us" << std::setw(10) << "cands" << "\n";
+  for (size_t c = 0; c < corpora.size(); c++) {
+    printRow(corpora[c].name, summaries[c]);
+  }
+  printRow("all", all);
+
+  // The same corpora against a database loaded in file order.
+  Database fileOrder("bench-file-order");
+  fileOrder.frequencyOrder = false;
+  fileOrder.load(csv);
+  const auto fileStore = fileOrder.current();
+  std::vector<std::pair<Quality, Quality>> qualities;
+  std::pair<Quality, Quality> allQuality;
+  for (const auto& corpus : corpora) {
+    qualities.emplace_back(measureQuality(*fileStore, corpus.queries), measureQuality(*store, corpus.queries));
+    allQuality.first += qualities.back().first;
+    allQuality.second += qualities.back().second;
+  }
+  std::cout << "\nagainst an unbounded scan\n" << std::setw(60) << "file order" << std::setw(40) << "frequency order" << "\n";
+  std::cout << std::left << std::setw(14) << "corpus" << std::right << std::setw(6) << "n";
+  for (int layout = 0; layout < 2; layout++) {
+    std::cout << std::setw(10) << "exact" << std::setw(10) << "recall10" << std::setw(10) << "scanned" << std::setw(10) << "unbound";
+  }
+  std::cout << "\n";
+  for (size_t c = 0; c < corpora.size(); c++) {
+    printQualityRow(corpora[c].name, qualities[c].first, qualities[c].second);
+  }
+  printQualityRow("all", allQuality.first, allQuality.second);
+
+  if (!options.json.empty()) {
+    std::ofstream out(options.json);
+    out << "{\"label\":" << quoted(options.label) << ",\"rows\":" << store->size() << ",\"rounds\":" << options.rounds
+        << ",\"threads\":" << options.threads << ",\"loadMs\":" << loadMs << ",\"peakRssBytes\":" << peakRss
+        << ",\"loadStats\":" << toJson(store->loadStats.fields()) << ",\"memory\":" << toJson(store->memoryUsage().fields())
+        << ",\"corpora\":{";
+    for (size_t c = 0; c < corpora.size(); c++) {
+      out << (c ? "," : "") << quoted(corpora[c].name) << ":" << toJson(summaries[c].fields());
+    }
+    out << "},\"all\":" << toJson(all.fields()) << ",\"quality\":{";
+    for (int layout = 0; layout < 2; layout++) {
+      out << (layout ? ",\"frequencyOrder\":{" : "\"fileOrder\":{");
+      for (size_t c = 0; c < corpora.size(); c++) {
+        const Quality& quality = layout ? qualities[c].second : qualities[c].first;
+        out << quoted(corpora[c].name) << ":" << toJson(quality.fields()) << ",";
+      }
+      out << "\"all\":" << toJson((layout ? allQuality.second : allQuality.first).fields()) << "}";
+    }
+    out << "}}\n";
+    if (!out) {
+      std::cerr << "Cannot write " << options.json << "\n";
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -1,49 +1,413 @@
 #include <napi.h>
 
-const int INITIAL_CUTOFF = 1600;
-const int FINAL_CUTOF = 256;
-
 #include "tagdb.hpp"
 
+// A result copied out of the store so it can be built off the JS thread.
+struct WordStrings {
+  std::string normalized;
+  std::string shortened;
+  std::string word;
+  std::string redirect;
+  int64_t freq;
+  int priority;
+  int category;
+};
+
+static std::vector<WordStrings> toStrings(const TagStore& store, const std::vector<Word>& result) {
+  std::vector<WordStrings> output;
+  output.reserve(result.size());
+  for (const auto& item : result) {
+    const WordText text = store.getText(item.id);
+    output.push_back({std::string(text.normalized), std::string(text.shortened), std::string(text.word), std::string(text.redirect), item.freq, item.priority, item.category});
+  }
+  return output;
+}
+
+// Runs convert, which turns search results into JS values, and records the
+// time it took as the marshal phase of db's search stats.
+template <class Convert>
+static Napi::Value marshal(const Database& db, Convert convert) {
+  const auto stats = db.searchStats();
+  PhaseTimer timer(stats->enabled() ? stats.get() : nullptr);
+  Napi::Value value = convert();
+  timer.lap(SearchPhase::Marshal);
+  return value;
+}
+
+// Wraps a buffer of PackedLayout in typed-array views over it:
+// {count, freq, category, priority, offsets, strings}.
+static Napi::Object toPacked(Napi::Env env, Napi::ArrayBuffer buffer, const PackedLayout& layout) {
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("count", Napi::Number::New(env, layout.count));
+  obj.Set("freq", Napi::Float64Array::New(env, layout.count, buffer, layout.freq));
+  obj.Set("category", Napi::Int32Array::New(env, layout.count, buffer, layout.category));
+  obj.Set("priority", Napi::Int32Array::New(env, layout.count, buffer, layout.priority));
+  obj.Set("offsets", Napi::Uint32Array::New(env, 4 * layout.count + 1, buffer, layout.offsets));
+  obj.Set("strings", Napi::Uint8Array::New(env, layout.stringBytes, buffer, layout.strings));
+  return obj;
+}
+
+// base with the keys present in value overridden, when it is an object:
+// {scanBudget, resultLimit, scoreShortened, timeBudgetMs, fuzzyResults,
+// fuzzyEdits, fuzzyTimeBudgetMs}.
+static SearchOptions toSearchOptions(const Napi::Value& value, SearchOptions base) {
+  if (!value.IsObject()) {
+    return base;
+  }
+  const Napi::Object obj = value.As<Napi::Object>();
+  if (obj.Get("scanBudget").IsNumber()) {
+    base.scanBudget = std::max<int64_t>(0, obj.Get("scanBudget").As<Napi::Number>().Int64Value());
+  }
+  if (obj.Get("resultLimit").IsNumber()) {
+    base.resultLimit = std::max<int64_t>(0, obj.Get("resultLimit").As<Napi::Number>().Int64Value());
+  }
+  if (obj.Get("scoreShortened").IsBoolean()) {
+    base.scoreShortened = obj.Get("scoreShortened").As<Napi::Boolean>().Value();
+  }
+  if (obj.Get("timeBudgetMs").IsNumber()) {
+    base.timeBudgetMs = std::max<int64_t>(0, obj.Get("timeBudgetMs").As<Napi::Number>().Int64Value());
+  }
+  if (obj.Get("fuzzyResults").IsNumber()) {
+    base.fuzzyResults = std::max<int64_t>(0, obj.Get("fuzzyResults").As<Napi::Number>().Int64Value());
+  }
+  if (obj.Get("fuzzyEdits").IsNumber()) {
+    base.fuzzyEdits = std::max<int64_t>(0, obj.Get("fuzzyEdits").As<Napi::Number>().Int64Value());
+  }
+  if (obj.Get("fuzzyTimeBudgetMs").IsNumber()) {
+    base.fuzzyTimeBudgetMs = std::max<int64_t>(0, obj.Get("fuzzyTimeBudgetMs").As<Napi::Number>().Int64Value());
+  }
+  return base;
+}
+
+// The options a search given value as its options argument runs with, or
+// none when it brings no options and db's own apply.
+static std::optional<SearchOptions> requestedOptions(const Napi::Value& value, const Database& db) {
+  if (!value.IsObject()) {
+    return std::nullopt;
+  }
+  return toSearchOptions(value, db.searchOptions());
+}
+
+static const SearchOptions* orNull(const std::optional<SearchOptions>& options) {
+  return options ? &*options : nullptr;
+}
+
+static Napi::Object toPacked(Napi::Env env, const TagStore& store, const std::vector<Word>& result) {
+  Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, store.packedSize(result));
+  const PackedLayout layout = store.pack(result, static_cast<char*>(buffer.Data()));
+  return toPacked(env, buffer, layout);
+}
+
+// Everything searchAsync keeps per (database, caller key). latest is bumped by
+// every call so that queued or running searches of the same caller notice
+// they were superseded and stop.
+struct SearchCaller {
+  std::atomic<uint64_t> latest{0};
+  SearchSession session;
+  SearchCaller(int dbId) : session(dbId) {}
+};
+
+// Runs one searchAsync call on the libuv thread pool. Resolves to null when
+// a newer search of the same caller was issued first.
+class SearchWorker : public Napi::AsyncWorker {
+ public:
+  SearchWorker(Napi::Env env, std::shared_ptr<Database> db, std::shared_ptr<SearchCaller> caller, const std::string& query, bool packed, std::optional<SearchOptions> options)
+      : Napi::AsyncWorker(env), deferred(Napi::Promise::Deferred::New(env)), db(db), store(db->current()), stats(db->searchStats()), caller(caller), query(query), generation(++caller->latest), packed(packed), options(options) {}
+
+  Napi::Promise Promise() const {
+    return deferred.Promise();
+  }
+
+  void Execute() override {
+    const SearchCancel cancel(caller->latest, generation);
+    if (cancel.cancelled()) {
+      return;
+    }
+    std::vector<Word> found = caller->session.search(*db, *store, query, &cancel, orNull(options));
+    if (cancel.cancelled()) {
+      return;
+    }
+    marshalStart = std::chrono::steady_clock::now();
+    if (packed) {
+      packedData.resize(store->packedSize(found));
+      layout = store->pack(found, packedData.data());
+    } else {
+      result = toStrings(*store, found);
+    }
+    completed = true;
+  }
+
+  void OnOK() override;
+
+  void OnError(const Napi::Error& error) override {
+    deferred.Reject(error.Value());
+  }
+
+ private:
+  Napi::Promise::Deferred deferred;
+  std::shared_ptr<Database> db;
+  std::shared_ptr<const TagStore> store;
+  std::shared_ptr<SearchStats> stats;
+  std::shared_ptr<SearchCaller> caller;
+  std::string query;
+  uint64_t generation;
+  bool packed;
+  std::optional<SearchOptions> options;
+  std::vector<WordStrings> result;
+  std::vector<char> packedData;
+  PackedLayout layout{0, 0};
+  bool completed = false;
+  // Marshalling spans Execute and OnOK; the time in between, spent queued
+  // for the JS thread, is counted too.
+  std::chrono::steady_clock::time_point marshalStart;
+};
+
+// Runs one loadFile call on the libuv thread pool, so searches keep being
+// answered, over the rows loaded so far, while it runs. Resolves to whether
+// the file could be read.
+class LoadWorker : public Napi::AsyncWorker {
+ public:
+  LoadWorker(Napi::Env env, std::shared_ptr<Database> db, const std::string& path, const std::string& snapshotPath)
+      : Napi::AsyncWorker(env), deferred(Napi::Promise::Deferred::New(env)), db(db), path(path), snapshotPath(snapshotPath) {}
+
+  Napi::Promise Promise() const {
+    return deferred.Promise();
+  }
+
+  void Execute() override {
+    loaded = db->loadFile(path, snapshotPath);
+  }
+
+  void OnOK() override {
+    deferred.Resolve(Napi::Boolean::New(Env(), loaded));
+  }
+
+  void OnError(const Napi::Error& error) override {
+    deferred.Reject(error.Value());
+  }
+
+ private:
+  Napi::Promise::Deferred deferred;
+  std::shared_ptr<Database> db;
+  std::string path;
+  std::string snapshotPath;
+  bool loaded = false;
+};
+
 class SDSAddOn : public Napi::Addon<SDSAddOn> {
  public:
   DatabaseRepository dbRepo;
-  SDSAddOn(Napi::Env env, Napi::Object exports) {
+  std::map<std::string, std::shared_ptr<SearchCaller>> callers;
+  friend class SearchWorker;
+  SDSAddOn(Napi::Env, Napi::Object exports) {
     DefineAddon(exports,
                 {InstanceMethod("createDB", &SDSAddOn::createDB, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("getSearchOptions", &SDSAddOn::getSearchOptions, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("setSearchOptions", &SDSAddOn::setSearchOptions, napi_enumerable)});
     DefineAddon(exports,
                 {InstanceMethod("search", &SDSAddOn::search, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("searchPacked", &SDSAddOn::searchPacked, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("searchAsync", &SDSAddOn::searchAsync, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("searchMany", &SDSAddOn::searchMany, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("lookupBatch", &SDSAddOn::lookupBatch, napi_enumerable)});
     DefineAddon(exports,
                 {InstanceMethod("loadDB", &SDSAddOn::loadDB, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("loadFile", &SDSAddOn::loadFile, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("upsert", &SDSAddOn::upsert, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("remove", &SDSAddOn::remove, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("batchApply", &SDSAddOn::batchApply, napi_enumerable)});
     DefineAddon(exports,
                 {InstanceMethod("releaseDB", &SDSAddOn::releaseDB, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("createSearchSession", &SDSAddOn::createSearchSession, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("searchSession", &SDSAddOn::searchSession, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("releaseSearchSession", &SDSAddOn::releaseSearchSession, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("getMemoryUsage", &SDSAddOn::getMemoryUsage, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("getLoadStats", &SDSAddOn::getLoadStats, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("getDanglingRedirects", &SDSAddOn::getDanglingRedirects, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("setLoadThreads", &SDSAddOn::setLoadThreads, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("setSearchThreads", &SDSAddOn::setSearchThreads, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("getCacheStats", &SDSAddOn::getCacheStats, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("setCacheBudget", &SDSAddOn::setCacheBudget, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("getStats", &SDSAddOn::getStats, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("resetStats", &SDSAddOn::resetStats, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("setStatsEnabled", &SDSAddOn::setStatsEnabled, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("saveSnapshot", &SDSAddOn::saveSnapshot, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("loadSnapshot", &SDSAddOn::loadSnapshot, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("recordUsage", &SDSAddOn::recordUsage, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("saveUsage", &SDSAddOn::saveUsage, napi_enumerable)});
+    DefineAddon(exports,
+                {InstanceMethod("loadUsage", &SDSAddOn::loadUsage, napi_enumerable)});
   }
 
  private:
+  // createDB(name, options?) with the search options of the database; see
+  // setSearchOptions.
   Napi::Value createDB(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     Napi::String input = info[0].As<Napi::String>();
     std::string name = input.Utf8Value();
-    dbRepo.create(name);
-    return Napi::Number::New(env, dbRepo.nextId - 1);
+    return Napi::Number::New(env, dbRepo.create(name, toSearchOptions(info[1], SearchOptions())));
+  }
+
+  Napi::Value getSearchOptions(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    const SearchOptions options = db->searchOptions();
+    Napi::Object output = toObject(env, options.fields());
+    output.Set("scoreShortened", Napi::Boolean::New(env, options.scoreShortened));
+    return output;
+  }
+
+  // setSearchOptions(id, {scanBudget?, resultLimit?, scoreShortened?,
+  // timeBudgetMs?, fuzzyResults?, fuzzyEdits?, fuzzyTimeBudgetMs?}) changes the given options of the database; the others
+  // keep their values. Every search function takes the same object as an
+  // optional last argument to override them for one query.
+  Napi::Value setSearchOptions(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    db->setSearchOptions(toSearchOptions(info[1], db->searchOptions()));
+    return env.Undefined();
   }
 
   Napi::Value search(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::String input = info[1].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    const auto store = db->current();
+    const auto options = requestedOptions(info[2], *db);
+    const std::vector<Word> found = db->search(*store, input.Utf8Value(), nullptr, orNull(options));
+    return marshal(*db, [&] { return toArray(env, toStrings(*store, found)); });
+  }
+
+  // Like search, but returns one buffer with typed-array views instead of
+  // an object per row; see PackedLayout.
+  Napi::Value searchPacked(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::String input = info[1].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    const auto store = db->current();
+    const auto options = requestedOptions(info[2], *db);
+    const std::vector<Word> found = db->search(*store, input.Utf8Value(), nullptr, orNull(options));
+    return marshal(*db, [&] { return toPacked(env, *store, found); });
+  }
+
+  // searchMany(id, queries, k, options?) runs all queries in one call and
+  // returns their best k rows packed as in searchPacked, with
+  // queryOffsets[i] to queryOffsets[i + 1] the rows of queries[i].
+  Napi::Value searchMany(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Array input = info[1].As<Napi::Array>();
+    Napi::Number k = info[2].As<Napi::Number>();
+    std::vector<std::string> queries(input.Length());
+    for (uint32_t i = 0; i < input.Length(); i++) {
+      queries[i] = input.Get(i).As<Napi::String>().Utf8Value();
+    }
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    const auto store = db->current();
+    SearchOptions options = toSearchOptions(info[3], db->searchOptions());
+    options.resultLimit = std::max(0, k.Int32Value());
+    std::vector<uint32_t> offsets;
+    const std::vector<Word> joined = joinResults(store->searchMany(queries, options), offsets);
+    Napi::Object packed = marshal(*db, [&] { return toPacked(env, *store, joined); }).As<Napi::Object>();
+    Napi::Uint32Array queryOffsets = Napi::Uint32Array::New(env, offsets.size());
+    std::memcpy(queryOffsets.Data(), offsets.data(), offsets.size() * sizeof(uint32_t));
+    packed.Set("queryOffsets", queryOffsets);
+    return packed;
+  }
+
+  // Searches on the thread pool and returns a promise. Callers are told apart
+  // by the third argument: a new call supersedes the pending ones of the same
+  // caller, whose promises resolve to null. With a true fourth argument the
+  // result is packed as in searchPacked. The fifth is the options of this
+  // search, as in setSearchOptions.
+  Napi::Value searchAsync(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     Napi::Number id = info[0].As<Napi::Number>();
     Napi::String input = info[1].As<Napi::String>();
-    Database& db = dbRepo.get(id.Int32Value());
-    std::vector<Word> result = db.search(input.Utf8Value());
-    Napi::Array output = Napi::Array::New(env, result.size());
-    for (size_t i = 0; i < result.size(); i++) {
-      Napi::Object obj = Napi::Object::New(env);
-      obj.Set("normalized", Napi::String::New(env, utf16ToUtf8(result[i].normalized)));
-      obj.Set("shortened", Napi::String::New(env, utf16ToUtf8(result[i].shortened)));
-      obj.Set("word", Napi::String::New(env, utf16ToUtf8(result[i].word)));
-      obj.Set("redirect", Napi::String::New(env, utf16ToUtf8(result[i].redirect)));
-      obj.Set("freq", Napi::Number::New(env, result[i].freq));
-      obj.Set("priority", Napi::Number::New(env, result[i].priority));
-      obj.Set("category", Napi::Number::New(env, result[i].category));
+    Napi::String callerKey = info[2].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    auto& caller = callers[std::to_string(id.Int32Value()) + ":" + callerKey.Utf8Value()];
+    if (!caller) {
+      caller = std::make_shared<SearchCaller>(id.Int32Value());
+    }
+    const bool packed = info.Length() > 3 && info[3].ToBoolean().Value();
+    SearchWorker* worker = new SearchWorker(env, db, caller, input.Utf8Value(), packed, requestedOptions(info[4], *db));
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
+  }
+
+  // lookupBatch(id, tags) returns, per tag, its row with the word it
+  // canonicalizes to, or null when the tag is not loaded.
+  Napi::Value lookupBatch(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Array input = info[1].As<Napi::Array>();
+    std::vector<std::string> tags(input.Length());
+    for (uint32_t i = 0; i < input.Length(); i++) {
+      tags[i] = input.Get(i).As<Napi::String>().Utf8Value();
+    }
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    const auto store = db->current();
+    const std::vector<uint32_t> rows = store->lookupBatch(tags);
+    Napi::Array output = Napi::Array::New(env, rows.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+      if (rows[i] == TagStore::NO_ROW) {
+        output[i] = env.Null();
+        continue;
+      }
+      const Word word = store->getWord(rows[i]);
+      const std::vector<WordStrings> strings = toStrings(*store, {word});
+      Napi::Object obj = toObject(env, strings[0]);
+      const std::string_view canonical = store->canonicalWord(rows[i]);
+      obj.Set("canonical", Napi::String::New(env, canonical.data(), canonical.size()));
       output[i] = obj;
     }
     return output;
@@ -51,20 +415,380 @@ class SDSAddOn : public Napi::Addon<SDSAddOn> {
 
   Napi::Value loadDB(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    Napi::Number id = info[0].As<Napi::Number>();
     Napi::String input = info[1].As<Napi::String>();
-    Database& db = dbRepo.get(id.Int32Value());
-    db.load(input.Utf8Value());
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    if (info.Length() > 2 && info[2].IsString()) {
+      db->loadWithSnapshot(input.Utf8Value(), info[2].As<Napi::String>().Utf8Value());
+    } else {
+      db->load(input.Utf8Value());
+    }
     return env.Undefined();
   }
 
+  // loadFile(id, path, snapshotPath?) returns a promise; see
+  // Database::loadFile().
+  Napi::Value loadFile(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::String path = info[1].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    const std::string snapshotPath = info.Length() > 2 && info[2].IsString() ? info[2].As<Napi::String>().Utf8Value() : std::string();
+    LoadWorker* worker = new LoadWorker(env, db, path.Utf8Value(), snapshotPath);
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
+  }
+
+  // upsert(id, word, category, freq, redirect = "null")
+  Napi::Value upsert(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    TagUpdate update;
+    update.word = info[1].As<Napi::String>().Utf8Value();
+    update.category = info[2].As<Napi::Number>().Int32Value();
+    update.freq = info[3].As<Napi::Number>().Int64Value();
+    if (info.Length() > 4 && info[4].IsString()) {
+      update.redirect = info[4].As<Napi::String>().Utf8Value();
+    }
+    return Napi::Boolean::New(env, db->upsert(update));
+  }
+
+  Napi::Value remove(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::String word = info[1].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    return Napi::Boolean::New(env, db->remove(word.Utf8Value()));
+  }
+
+  // batchApply(id, [{word, category?, freq?, redirect?, remove?}, ...])
+  Napi::Value batchApply(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Array ops = info[1].As<Napi::Array>();
+    std::vector<TagUpdate> updates(ops.Length());
+    for (uint32_t i = 0; i < ops.Length(); i++) {
+      updates[i] = toUpdate(ops.Get(i).As<Napi::Object>());
+    }
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    return Napi::Number::New(env, db->batchApply(updates));
+  }
+
+  Napi::Value saveSnapshot(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::String path = info[1].As<Napi::String>();
+    Napi::String source = info[2].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    bool saved = db->saveSnapshot(path.Utf8Value(), sourceHash(source.Utf8Value()));
+    return Napi::Boolean::New(env, saved);
+  }
+
+  Napi::Value loadSnapshot(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::String path = info[1].As<Napi::String>();
+    Napi::String source = info[2].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    bool loaded = db->loadSnapshot(path.Utf8Value(), sourceHash(source.Utf8Value()));
+    return Napi::Boolean::New(env, loaded);
+  }
+
+  // recordUsage(id, tag) counts tag as an accepted completion; see
+  // Database::recordUsage().
+  Napi::Value recordUsage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::String tag = info[1].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    return Napi::Boolean::New(env, db->recordUsage(tag.Utf8Value()));
+  }
+
+  Napi::Value saveUsage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::String path = info[1].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    return Napi::Boolean::New(env, db->saveUsage(path.Utf8Value()));
+  }
+
+  Napi::Value loadUsage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::String path = info[1].As<Napi::String>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    return Napi::Boolean::New(env, db->loadUsage(path.Utf8Value()));
+  }
+
   Napi::Value releaseDB(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     Napi::Number id = info[0].As<Napi::Number>();
-    dbRepo.release(id.Int32Value());
+    if (!dbRepo.release(id.Int32Value())) {
+      return unknownId(env, "database");
+    }
+    const std::string prefix = std::to_string(id.Int32Value()) + ":";
+    for (auto it = callers.lower_bound(prefix); it != callers.end() && it->first.compare(0, prefix.size(), prefix) == 0;) {
+      it = callers.erase(it);
+    }
+    return env.Undefined();
+  }
+
+  Napi::Value createSearchSession(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Number id = info[0].As<Napi::Number>();
+    const int sessionId = dbRepo.createSession(id.Int32Value());
+    if (sessionId < 0) {
+      return unknownId(env, "database");
+    }
+    return Napi::Number::New(env, sessionId);
+  }
+
+  Napi::Value searchSession(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Number id = info[0].As<Napi::Number>();
+    Napi::String input = info[1].As<Napi::String>();
+    const auto session = dbRepo.getSession(id.Int32Value());
+    const auto db = session ? dbRepo.get(session->dbId) : nullptr;
+    if (!db) {
+      return unknownId(env, "search session");
+    }
+    const auto store = db->current();
+    const auto options = requestedOptions(info[2], *db);
+    const std::vector<Word> found = session->search(*db, *store, input.Utf8Value(), nullptr, orNull(options));
+    return marshal(*db, [&] { return toArray(env, toStrings(*store, found)); });
+  }
+
+  Napi::Value releaseSearchSession(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Number id = info[0].As<Napi::Number>();
+    if (!dbRepo.releaseSession(id.Int32Value())) {
+      return unknownId(env, "search session");
+    }
     return env.Undefined();
   }
+
+  Napi::Value getMemoryUsage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    return toObject(env, db->memoryUsage().fields());
+  }
+
+  Napi::Value getLoadStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    return toObject(env, db->loadStats().fields());
+  }
+
+  // Redirect targets of the loaded aliases that are not loaded themselves.
+  Napi::Value getDanglingRedirects(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    const auto store = db->current();
+    const std::vector<std::string_view> targets = store->danglingRedirects();
+    Napi::Array output = Napi::Array::New(env, targets.size());
+    for (size_t i = 0; i < targets.size(); i++) {
+      output[i] = Napi::String::New(env, targets[i].data(), targets[i].size());
+    }
+    return output;
+  }
+
+  Napi::Value setLoadThreads(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Number threads = info[1].As<Napi::Number>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    db->loadThreads = threads.Uint32Value();
+    return env.Undefined();
+  }
+
+  Napi::Value setSearchThreads(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Number threads = info[1].As<Napi::Number>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    db->setSearchThreads(threads.Uint32Value());
+    return env.Undefined();
+  }
+
+  Napi::Value getCacheStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    return toObject(env, db->cacheStats().fields());
+  }
+
+  // Search counters and per-phase timings, with the raw latency histograms
+  // under `histograms`; see SearchStats.
+  Napi::Value getStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    const auto stats = db->searchStats();
+    Napi::Object output = toObject(env, stats->fields());
+    Napi::Object histograms = Napi::Object::New(env);
+    for (size_t p = 0; p < SearchStats::PHASES; p++) {
+      const std::vector<uint64_t> counts = stats->histogram(SearchPhase(p));
+      Napi::Array buckets = Napi::Array::New(env, counts.size());
+      for (size_t i = 0; i < counts.size(); i++) {
+        buckets.Set(i, Napi::Number::New(env, counts[i]));
+      }
+      histograms.Set(SearchStats::phaseName(SearchPhase(p)), buckets);
+    }
+    output.Set("histograms", histograms);
+    return output;
+  }
+
+  Napi::Value resetStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    db->searchStats()->reset();
+    return env.Undefined();
+  }
+
+  Napi::Value setStatsEnabled(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const bool enabled = info[1].ToBoolean().Value();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    db->searchStats()->setEnabled(enabled);
+    return env.Undefined();
+  }
+
+  // setCacheBudget(id, bytes) bounds the memory of the database's query
+  // cache; 0 turns it off.
+  Napi::Value setCacheBudget(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Number bytes = info[1].As<Napi::Number>();
+    const auto db = database(info);
+    if (!db) {
+      return env.Undefined();
+    }
+    db->setCacheBudget(std::max<int64_t>(0, bytes.Int64Value()));
+    return env.Undefined();
+  }
+
+  // The database named by the first argument. Null, with a JS error thrown,
+  // when the id is unknown or was released.
+  std::shared_ptr<Database> database(const Napi::CallbackInfo& info) {
+    auto db = dbRepo.get(info[0].As<Napi::Number>().Int32Value());
+    if (!db) {
+      unknownId(info.Env(), "database");
+    }
+    return db;
+  }
+
+  static Napi::Value unknownId(Napi::Env env, const std::string& kind) {
+    Napi::Error::New(env, "Unknown " + kind + " id").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  static TagUpdate toUpdate(const Napi::Object& op) {
+    TagUpdate update;
+    update.word = op.Get("word").As<Napi::String>().Utf8Value();
+    update.remove = op.Get("remove").ToBoolean().Value();
+    if (op.Get("category").IsNumber()) {
+      update.category = op.Get("category").As<Napi::Number>().Int32Value();
+    }
+    if (op.Get("freq").IsNumber()) {
+      update.freq = op.Get("freq").As<Napi::Number>().Int64Value();
+    }
+    if (op.Get("redirect").IsString()) {
+      update.redirect = op.Get("redirect").As<Napi::String>().Utf8Value();
+    }
+    return update;
+  }
+
+  static Napi::Object toObject(Napi::Env env, const std::vector<std::pair<std::string, double>>& fields) {
+    Napi::Object obj = Napi::Object::New(env);
+    for (const auto& [key, value] : fields) {
+      obj.Set(key, Napi::Number::New(env, value));
+    }
+    return obj;
+  }
+
+  static Napi::Object toObject(Napi::Env env, const WordStrings& item) {
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("normalized", Napi::String::New(env, item.normalized));
+    obj.Set("shortened", Napi::String::New(env, item.shortened));
+    obj.Set("word", Napi::String::New(env, item.word));
+    obj.Set("redirect", Napi::String::New(env, item.redirect));
+    obj.Set("freq", Napi::Number::New(env, item.freq));
+    obj.Set("priority", Napi::Number::New(env, item.priority));
+    obj.Set("category", Napi::Number::New(env, item.category));
+    return obj;
+  }
+
+  static Napi::Array toArray(Napi::Env env, const std::vector<WordStrings>& result) {
+    Napi::Array output = Napi::Array::New(env, result.size());
+    for (size_t i = 0; i < result.size(); i++) {
+      output[i] = toObject(env, result[i]);
+    }
+    return output;
+  }
 };
 
+void SearchWorker::OnOK() {
+  if (!completed) {
+    deferred.Resolve(Env().Null());
+    return;
+  }
+  if (packed) {
+    // Electron does not allow external array buffers, so the packed bytes
+    // are copied once into a V8-owned one.
+    Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(Env(), packedData.size());
+    std::memcpy(buffer.Data(), packedData.data(), packedData.size());
+    deferred.Resolve(toPacked(Env(), buffer, layout));
+  } else {
+    deferred.Resolve(SDSAddOn::toArray(Env(), result));
+  }
+  if (stats->enabled()) {
+    stats->time(SearchPhase::Marshal, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - marshalStart).count());
+  }
+}
+
 NODE_API_ADDON(SDSAddOn)
 
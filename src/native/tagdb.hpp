@@ -4,34 +4,206 @@
 #include <string>
 #include <sstream>
 #include <array>
+#include <bitset>
+#include <iterator>
 #include <iostream>
-#include <deque>
+#include <iomanip>
 #include <map>
 #include <set>
 #include <memory>
+#include <optional>
 #include <algorithm>
 #include <numeric>
 #include <locale>
 #include <codecvt>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <queue>
+#include <deque>
+#include <list>
+#include <cctype>
+#include <cmath>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
+// A row of the database as handed out to callers. The strings point into the
+// owning Database's arenas and stay valid until the next load.
 class Word {
 public:
-  std::wstring_view normalized;
-  std::wstring_view shortened;
-  std::wstring_view word;
-  std::wstring_view redirect;
+  std::u16string_view normalized;
+  std::u16string_view shortened;
+  std::u16string_view word;
+  std::u16string_view redirect;
   int64_t freq;
   int category;
   int priority;
-  Word(std::wstring_view normalized, std::wstring_view shortened, std::wstring_view word, std::wstring_view redirect, int64_t freq, int category, int priority) :
-    normalized(normalized), shortened(shortened), word(word), redirect(redirect), freq(freq), category(category), priority(priority) {}
+  uint32_t id;
+  Word(std::u16string_view normalized, std::u16string_view shortened, std::u16string_view word, std::u16string_view redirect, int64_t freq, int category, int priority, uint32_t id) :
+    normalized(normalized), shortened(shortened), word(word), redirect(redirect), freq(freq), category(category), priority(priority), id(id) {}
+};
+
+struct StringRef {
+  uint32_t offset;
+  uint32_t length;
+};
+
+// Packs strings back to back into one buffer of utf-16 code units.
+class StringArena {
+public:
+  std::vector<char16_t> data;
+
+  StringRef add(std::u16string_view str) {
+    StringRef ref{uint32_t(data.size()), uint32_t(str.size())};
+    data.insert(data.end(), str.begin(), str.end());
+    return ref;
+  }
+
+  std::u16string_view get(StringRef ref) const {
+    return std::u16string_view(data.data() + ref.offset, ref.length);
+  }
+
+  void clear() {
+    data.clear();
+  }
+
+  void shrink_to_fit() {
+    data.shrink_to_fit();
+  }
+
+  size_t bytes() const {
+    return data.capacity() * sizeof(char16_t);
+  }
+};
+
+// One string per row stored contiguously in row order, so that scanning the
+// column walks memory linearly.
+template <class Char>
+class BasicStringColumn {
+public:
+  BasicStringColumn() : offsets{0} {}
+
+  void push_back(std::basic_string_view<Char> str) {
+    data.insert(data.end(), str.begin(), str.end());
+    offsets.push_back(data.size());
+  }
+
+  void append(const BasicStringColumn& other) {
+    const uint32_t base = data.size();
+    data.insert(data.end(), other.data.begin(), other.data.end());
+    for (size_t i = 1; i < other.offsets.size(); i++) {
+      offsets.push_back(base + other.offsets[i]);
+    }
+  }
+
+  std::basic_string_view<Char> operator[](uint32_t id) const {
+    return std::basic_string_view<Char>(data.data() + offsets[id], offsets[id + 1] - offsets[id]);
+  }
+
+  uint32_t size() const {
+    return offsets.size() - 1;
+  }
+
+  void clear() {
+    data.clear();
+    offsets.assign(1, 0);
+  }
+
+  void shrink_to_fit() {
+    data.shrink_to_fit();
+    offsets.shrink_to_fit();
+  }
+
+  size_t bytes() const {
+    return data.capacity() * sizeof(Char) + offsets.capacity() * sizeof(uint32_t);
+  }
+
+  std::vector<Char> data;
+  std::vector<uint32_t> offsets;
+};
+
+using StringColumn = BasicStringColumn<char16_t>;
+using Utf8Column = BasicStringColumn<char>;
+
+// The UTF-8 forms of a row, as they were loaded.
+struct WordText {
+  std::string_view normalized;
+  std::string_view shortened;
+  std::string_view word;
+  std::string_view redirect;
+};
+
+// Layout of a packed result of `count` rows, one little-endian buffer the
+// bindings hand out whole: a header of count and the string byte length as
+// uint32, freq as float64, category and priority as int32, 4 * count + 1
+// uint32 offsets delimiting each row's normalized, shortened, word and
+// redirect, then the UTF-8 bytes. Every column is aligned for its type so
+// it can be viewed as a typed array in place.
+struct PackedLayout {
+  uint32_t count;
+  uint32_t stringBytes;
+  size_t freq;
+  size_t category;
+  size_t priority;
+  size_t offsets;
+  size_t strings;
+  size_t size;
+
+  PackedLayout(uint32_t count, uint32_t stringBytes) : count(count), stringBytes(stringBytes) {
+    freq = 2 * sizeof(uint32_t);
+    category = freq + count * sizeof(double);
+    priority = category + count * sizeof(int32_t);
+    offsets = priority + count * sizeof(int32_t);
+    strings = offsets + (4 * count + 1) * sizeof(uint32_t);
+    size = strings + stringBytes;
+  }
+};
+
+// Joins the results of several queries into one to be packed together.
+// offsets gets lists.size() + 1 entries; list i is rows [offsets[i],
+// offsets[i + 1]) of the joined result.
+static inline std::vector<Word> joinResults(const std::vector<std::vector<Word>>& lists, std::vector<uint32_t>& offsets) {
+  std::vector<Word> joined;
+  offsets.assign(1, 0);
+  for (const auto& list : lists) {
+    joined.insert(joined.end(), list.begin(), list.end());
+    offsets.push_back(joined.size());
+  }
+  return joined;
+}
+
+// Everything about a row except its normalized form, which is only needed
+// once a row has matched.
+struct WordRecord {
+  StringRef shortened;
+  StringRef word;
+  uint32_t redirect;
+  int32_t category;
+  int64_t freq;
+  int32_t priority;
 };
 
-static inline bool beginsWith(std::wstring_view str, std::wstring_view prefix) {
+static inline bool beginsWith(std::u16string_view str, std::u16string_view prefix) {
   return str.size() >= prefix.size() && str.substr(0, prefix.size()) == prefix;
 }
 
-static inline bool endsWith(std::wstring_view str, std::wstring_view suffix) {
+static inline bool endsWith(std::u16string_view str, std::u16string_view suffix) {
   return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
 }
 
@@ -61,432 +233,3742 @@ std::string join(const std::vector<std::string>& parts, char delim) {
 
 const int MAX_WORD_LEN = 64;
 
-static inline int calcGapMatch(std::wstring_view small, std::wstring_view large) {
+// Returns the minimum number of contiguous runs that small has to be split
+// into to appear as a subsequence of large, 0 for a prefix or suffix match
+// and inf when small is not a subsequence of large at all. Words longer than
+// MAX_WORD_LEN only match as prefix or suffix; tooLong, when given, counts
+// them.
+//
+// Bit-parallel over the positions of large: with at most `cost` runs, state
+// holds every position of large where small[0..i] can end. A run continues
+// by shifting the state one position to the right, and a new run can open
+// anywhere after the earliest position reachable with one run less.
+static inline int calcGapMatch(std::u16string_view small, std::u16string_view large, uint64_t* tooLong = nullptr) {
   if (beginsWith(large, small) || endsWith(large, small)) {
     return 0;
   }
   const int inf = 1e9;
   if (small.size() > MAX_WORD_LEN || large.size() > MAX_WORD_LEN) {
-    std::cerr << "Word too long\n";
+    if (tooLong) {
+      ++*tooLong;
+    }
     return inf;
   }
 
-  int m = small.size();
-  int n = large.size();
-  std::array<std::array<std::array<int,2>,MAX_WORD_LEN+1>,MAX_WORD_LEN+1> dp{};
-  for (int i = 0; i <= m; i++) {
-    for (int j = 0; j <= n; j++) {
-      dp[i][j][0] = inf;
-      dp[i][j][1] = inf;
+  const int m = small.size();
+  const int n = large.size();
+  std::array<uint64_t, MAX_WORD_LEN> match;
+  for (int i = 0; i < m; i++) {
+    uint64_t mask = 0;
+    for (int j = 0; j < n; j++) {
+      mask |= uint64_t(small[i] == large[j]) << j;
     }
+    match[i] = mask;
   }
-  dp[0][0][0] = 0;
-  for (int i=0;i<=m;i++){
-    for (int j=0;j<n;j++){
-      if (small[i] == large[j]) {
-        dp[i+1][j+1][1] = std::min({dp[i+1][j+1][1], dp[i][j][0]+1, dp[i][j][1]});
+
+  std::array<uint64_t, MAX_WORD_LEN> prev{}, cur;
+  for (int cost = 1; cost <= m; cost++) {
+    uint64_t state = match[0];
+    cur[0] = state;
+    for (int i = 1; i < m; i++) {
+      const uint64_t earliest = prev[i - 1] & (~prev[i - 1] + 1);
+      const uint64_t opened = match[i] & ~((earliest << 1) - 1) & -uint64_t(earliest != 0);
+      state = ((state << 1) & match[i]) | opened;
+      cur[i] = state;
+    }
+    if (state) {
+      return cost;
+    }
+    if (std::equal(cur.begin(), cur.begin() + m, prev.begin())) {
+      return inf;
+    }
+    prev = cur;
+  }
+  return inf;
+}
+
+// A pattern of at most MAX_WORD_LEN code units, set up for finding how many
+// edits it is away from the closest substring of a text.
+//
+// Bit-parallel over the positions of the pattern (Myers 1999): pv and mv
+// mark where the edit distances of consecutive pattern prefixes at the
+// current text position go up or down by one, so a text code unit costs a
+// handful of word operations and the last row's distance is tracked in
+// score.
+class EditPattern {
+public:
+  explicit EditPattern(std::u16string_view pattern) : length(pattern.size()) {
+    for (size_t i = 0; i < pattern.size() && i < MAX_WORD_LEN; i++) {
+      const char16_t ch = pattern[i];
+      const uint64_t bit = uint64_t(1) << i;
+      if (ch < ascii.size()) {
+        ascii[ch] |= bit;
+        continue;
+      }
+      auto it = std::find_if(others.begin(), others.end(), [&](const auto& entry) {
+        return entry.first == ch;
+      });
+      if (it == others.end()) {
+        others.emplace_back(ch, bit);
+      } else {
+        it->second |= bit;
+      }
+    }
+  }
+
+  // The fewest edits that turn the pattern into some substring of text, or
+  // maxEdits + 1 when that takes more than maxEdits.
+  int distance(std::u16string_view text, int maxEdits) const {
+    if (length == 0 || length > MAX_WORD_LEN) {
+      return length == 0 ? 0 : maxEdits + 1;
+    }
+    const uint64_t last = uint64_t(1) << (length - 1);
+    uint64_t pv = ~uint64_t(0), mv = 0;
+    int score = length, best = length;
+    for (char16_t ch : text) {
+      const uint64_t eq = mask(ch);
+      const uint64_t xv = eq | mv;
+      const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+      // The top row is all zeros, since a match may start anywhere, so
+      // nothing is shifted in.
+      const uint64_t ph = mv | ~(xh | pv);
+      const uint64_t mh = pv & xh;
+      score += (ph & last) != 0;
+      score -= (mh & last) != 0;
+      pv = (mh << 1) | ~(xv | (ph << 1));
+      mv = (ph << 1) & xv;
+      best = std::min(best, score);
+      if (best == 0) {
+        break;
+      }
+    }
+    return std::min(best, maxEdits + 1);
+  }
+
+private:
+  size_t length;
+  std::array<uint64_t, 128> ascii{};
+  std::vector<std::pair<char16_t, uint64_t>> others;
+
+  uint64_t mask(char16_t ch) const {
+    if (ch < ascii.size()) {
+      return ascii[ch];
+    }
+    for (const auto& entry : others) {
+      if (entry.first == ch) {
+        return entry.second;
       }
-      dp[i][j+1][0] = std::min({dp[i][j+1][0], dp[i][j][0], dp[i][j][1]});
     }
+    return 0;
+  }
+};
+
+// Decodes the code point at utf8[i] and moves i past it, as leniently as the
+// loader always has: the lead byte alone gives the length, continuation bytes
+// are not checked and bytes past the end read as 0.
+static inline uint32_t decodeUtf8(std::string_view utf8, size_t& i) {
+  const auto at = [&](size_t k) -> uint32_t {
+    return k < utf8.size() ? static_cast<unsigned char>(utf8[k]) : 0;
+  };
+  const uint32_t c = at(i);
+  uint32_t codepoint;
+  if (c < 0x80) {
+    codepoint = c;
+    i += 1;
+  } else if (c < 0xE0) {
+    codepoint = ((c & 0x1F) << 6) | (at(i + 1) & 0x3F);
+    i += 2;
+  } else if (c < 0xF0) {
+    codepoint = ((c & 0x0F) << 12) | ((at(i + 1) & 0x3F) << 6) | (at(i + 2) & 0x3F);
+    i += 3;
+  } else {
+    codepoint = ((c & 0x07) << 18) | ((at(i + 1) & 0x3F) << 12) | ((at(i + 2) & 0x3F) << 6) | (at(i + 3) & 0x3F);
+    i += 4;
   }
-  return std::min(dp[m][n][0], dp[m][n][1]);
+  return codepoint;
 }
 
-static inline std::wstring utf8ToUtf16(const std::string& utf8) {
-  std::wstring utf16;
+// Writes codepoint as UTF-8 and returns the bytes written, none past
+// U+10FFFF.
+static inline size_t encodeUtf8(uint32_t codepoint, char* out) {
+  if (codepoint <= 0x7F) {
+    out[0] = static_cast<char>(codepoint);
+    return 1;
+  }
+  if (codepoint <= 0x7FF) {
+    out[0] = static_cast<char>(0xC0 | (codepoint >> 6));
+    out[1] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 2;
+  }
+  if (codepoint <= 0xFFFF) {
+    out[0] = static_cast<char>(0xE0 | (codepoint >> 12));
+    out[1] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+    out[2] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 3;
+  }
+  if (codepoint <= 0x10FFFF) {
+    out[0] = static_cast<char>(0xF0 | (codepoint >> 18));
+    out[1] = static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 4;
+  }
+  return 0;
+}
+
+// Whether the 8 bytes at s are all ascii.
+static inline bool isAscii8(const char* s, uint64_t& chunk) {
+  std::memcpy(&chunk, s, sizeof(chunk));
+  return (chunk & 0x8080808080808080) == 0;
+}
+
+// Converts utf8 into out, which must hold utf8.size() code units, and returns
+// the units written. Malformed input converts to nothing.
+static inline size_t utf8ToUtf16(std::string_view utf8, char16_t* out) {
+  char16_t* const start = out;
   for (size_t i = 0; i < utf8.size();) {
+    uint64_t chunk;
+    if (i + 8 <= utf8.size() && isAscii8(utf8.data() + i, chunk)) {
+      for (size_t k = 0; k < 8; k++) {
+        out[k] = static_cast<unsigned char>(utf8[i + k]);
+      }
+      out += 8;
+      i += 8;
+      continue;
+    }
+    const unsigned char lead = utf8[i];
     uint32_t codepoint = 0;
     size_t additionalBytes = 0;
-
-    if ((utf8[i] & 0x80) == 0) {
-      codepoint = utf8[i];
-      additionalBytes = 0;
-    } else if ((utf8[i] & 0xE0) == 0xC0) {
-      codepoint = utf8[i] & 0x1F;
+    if ((lead & 0x80) == 0) {
+      codepoint = lead;
+    } else if ((lead & 0xE0) == 0xC0) {
+      codepoint = lead & 0x1F;
       additionalBytes = 1;
-    } else if ((utf8[i] & 0xF0) == 0xE0) {
-      codepoint = utf8[i] & 0x0F;
+    } else if ((lead & 0xF0) == 0xE0) {
+      codepoint = lead & 0x0F;
       additionalBytes = 2;
-    } else if ((utf8[i] & 0xF8) == 0xF0) {
-      codepoint = utf8[i] & 0x07;
+    } else if ((lead & 0xF8) == 0xF0) {
+      codepoint = lead & 0x07;
       additionalBytes = 3;
     } else {
-      return L"";
+      return 0;
     }
-
     if (i + additionalBytes >= utf8.size()) {
-      return L"";
+      return 0;
     }
-
     for (size_t j = 0; j < additionalBytes; ++j) {
       codepoint = (codepoint << 6) | (utf8[i + j + 1] & 0x3F);
     }
-
     if (codepoint <= 0xFFFF) {
-      utf16.push_back(static_cast<wchar_t>(codepoint));
+      *out++ = static_cast<char16_t>(codepoint);
     } else {
       codepoint -= 0x10000;
-      utf16.push_back(static_cast<wchar_t>(0xD800 + (codepoint >> 10)));
-      utf16.push_back(static_cast<wchar_t>(0xDC00 + (codepoint & 0x3FF)));
+      *out++ = static_cast<char16_t>(0xD800 + (codepoint >> 10));
+      *out++ = static_cast<char16_t>(0xDC00 + (codepoint & 0x3FF));
     }
-
     i += additionalBytes + 1;
   }
+  return out - start;
+}
 
+// utf8ToUtf16() into buffer, whose capacity is kept for the next call.
+static inline std::u16string_view utf8ToUtf16(std::string_view utf8, std::u16string& buffer) {
+  buffer.resize(utf8.size());
+  return std::u16string_view(buffer.data(), utf8ToUtf16(utf8, buffer.data()));
+}
+
+static inline std::u16string utf8ToUtf16(std::string_view utf8) {
+  std::u16string utf16;
+  utf16.resize(utf8ToUtf16(utf8, utf16).size());
   return utf16;
 }
 
-static inline std::string utf16ToUtf8(const std::wstring& utf16) {
-    std::string utf8;
-    for (size_t i = 0; i < utf16.size(); ++i) {
-        uint32_t codepoint;
+// Converts utf16 into out, which must hold 3 * utf16.size() bytes, and
+// returns the bytes written. An unpaired high surrogate converts the whole
+// string to nothing.
+static inline size_t utf16ToUtf8(std::u16string_view utf16, char* out) {
+  char* const start = out;
+  for (size_t i = 0; i < utf16.size(); ++i) {
+    if (i + 4 <= utf16.size() && (utf16[i] | utf16[i + 1] | utf16[i + 2] | utf16[i + 3]) < 0x80) {
+      for (size_t k = 0; k < 4; k++) {
+        out[k] = static_cast<char>(utf16[i + k]);
+      }
+      out += 4;
+      i += 3;
+      continue;
+    }
+    uint32_t codepoint = utf16[i];
+    if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+      if (i + 1 >= utf16.size() || utf16[i + 1] < 0xDC00 || utf16[i + 1] > 0xDFFF) {
+        return 0;
+      }
+      codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (utf16[i + 1] - 0xDC00);
+      ++i;
+    }
+    out += encodeUtf8(codepoint, out);
+  }
+  return out - start;
+}
+
+static inline std::string utf16ToUtf8(std::u16string_view utf16) {
+  std::string utf8(3 * utf16.size(), '\0');
+  utf8.resize(utf16ToUtf8(utf16, utf8.data()));
+  return utf8;
+}
 
-        if (utf16[i] >= 0xD800 && utf16[i] <= 0xDBFF) {
-            if (i + 1 >= utf16.size() || utf16[i + 1] < 0xDC00 || utf16[i + 1] > 0xDFFF) {
-                return "";
-            }
+// normalize() spells Hangul with compatibility jamo, each compound one split
+// into its parts: the conjoining jamo U+1100..U+11FF fold into the
+// compatibility block U+3130..U+318F, and ㄲ becomes ㄱㄱ, ㅘ becomes ㅗㅏ and
+// ㄳ becomes ㄱㅅ. These tables give each code point of the two blocks its
+// one or two parts; second is 0 when there is one.
+struct JamoParts {
+  char16_t first;
+  char16_t second;
+};
 
-            codepoint = 0x10000 + ((utf16[i] - 0xD800) << 10) + (utf16[i + 1] - 0xDC00);
-            ++i;
-        } else {
-            codepoint = utf16[i];
-        }
+static constexpr uint32_t CONJOINING_JAMO_BASE = 0x1100;
+static constexpr uint32_t COMPAT_JAMO_BASE = 0x3130;
 
-        if (codepoint <= 0x7F) {
-            utf8.push_back(static_cast<char>(codepoint));
-        } else if (codepoint <= 0x7FF) {
-            utf8.push_back(static_cast<char>((codepoint >> 6) | 0xC0));
-            utf8.push_back(static_cast<char>((codepoint & 0x3F) | 0x80));
-        } else if (codepoint <= 0xFFFF) {
-            utf8.push_back(static_cast<char>((codepoint >> 12) | 0xE0));
-            utf8.push_back(static_cast<char>(((codepoint >> 6) & 0x3F) | 0x80));
-            utf8.push_back(static_cast<char>((codepoint & 0x3F) | 0x80));
-        } else {
-            utf8.push_back(static_cast<char>((codepoint >> 18) | 0xF0));
-            utf8.push_back(static_cast<char>(((codepoint >> 12) & 0x3F) | 0x80));
-            utf8.push_back(static_cast<char>(((codepoint >> 6) & 0x3F) | 0x80));
-            utf8.push_back(static_cast<char>((codepoint & 0x3F) | 0x80));
-        }
+static constexpr std::array<JamoParts, 0x60> COMPAT_JAMO_PARTS = [] {
+  std::array<JamoParts, 0x60> table{};
+  for (size_t i = 0; i < table.size(); i++) {
+    table[i] = {char16_t(COMPAT_JAMO_BASE + i), 0};
+  }
+  constexpr char16_t compounds[][3] = {
+    {u'ㅘ', u'ㅗ', u'ㅏ'}, {u'ㅙ', u'ㅗ', u'ㅐ'}, {u'ㅚ', u'ㅗ', u'ㅣ'}, {u'ㅝ', u'ㅜ', u'ㅓ'},
+    {u'ㅞ', u'ㅜ', u'ㅔ'}, {u'ㅟ', u'ㅜ', u'ㅣ'}, {u'ㅢ', u'ㅡ', u'ㅣ'},
+    {u'ㄳ', u'ㄱ', u'ㅅ'}, {u'ㄵ', u'ㄴ', u'ㅈ'}, {u'ㄶ', u'ㄴ', u'ㅎ'}, {u'ㄺ', u'ㄹ', u'ㄱ'},
+    {u'ㄻ', u'ㄹ', u'ㅁ'}, {u'ㄼ', u'ㄹ', u'ㅂ'}, {u'ㄽ', u'ㄹ', u'ㅅ'}, {u'ㄾ', u'ㄹ', u'ㅌ'},
+    {u'ㄿ', u'ㄹ', u'ㅍ'}, {u'ㅀ', u'ㄹ', u'ㅎ'}, {u'ㅄ', u'ㅂ', u'ㅅ'},
+    {u'ㄲ', u'ㄱ', u'ㄱ'}, {u'ㄸ', u'ㄷ', u'ㄷ'}, {u'ㅃ', u'ㅂ', u'ㅂ'}, {u'ㅆ', u'ㅅ', u'ㅅ'}, {u'ㅉ', u'ㅈ', u'ㅈ'},
+  };
+  for (const auto& compound : compounds) {
+    table[compound[0] - COMPAT_JAMO_BASE] = {compound[1], compound[2]};
+  }
+  return table;
+}();
+
+static constexpr std::array<JamoParts, 0x100> CONJOINING_JAMO_PARTS = [] {
+  std::array<JamoParts, 0x100> table{};
+  for (size_t i = 0; i < table.size(); i++) {
+    table[i] = {char16_t(CONJOINING_JAMO_BASE + i), 0};
+  }
+  // Leading consonants from U+1100, vowels from U+1161 and trailing
+  // consonants from U+11A8, in the order syllables number them.
+  constexpr char16_t initials[] = u"ㄱㄲㄴㄷㄸㄹㅁㅂㅃㅅㅆㅇㅈㅉㅊㅋㅌㅍㅎ";
+  constexpr char16_t medials[] = u"ㅏㅐㅑㅒㅓㅔㅕㅖㅗㅘㅙㅚㅛㅜㅝㅞㅟㅠㅡㅢㅣ";
+  constexpr char16_t finals[] = u"ㄱㄲㄳㄴㄵㄶㄷㄹㄺㄻㄼㄽㄾㄿㅀㅁㅂㅄㅅㅆㅇㅈㅊㅋㅌㅍㅎ";
+  for (size_t i = 0; i + 1 < std::size(initials); i++) {
+    table[0x00 + i].first = initials[i];
+  }
+  for (size_t i = 0; i + 1 < std::size(medials); i++) {
+    table[0x61 + i].first = medials[i];
+  }
+  for (size_t i = 0; i + 1 < std::size(finals); i++) {
+    table[0xA8 + i].first = finals[i];
+  }
+  // Archaic jamo that have a compatibility form.
+  table[0x40].first = table[0xEB].first = u'ㅿ';
+  table[0x4C].first = table[0xF0].first = u'ㆁ';
+  table[0x59].first = table[0xF9].first = u'ㆆ';
+  table[0x9E].first = u'ㆍ';
+  for (auto& parts : table) {
+    if (parts.first >= COMPAT_JAMO_BASE && parts.first < COMPAT_JAMO_BASE + COMPAT_JAMO_PARTS.size()) {
+      parts = COMPAT_JAMO_PARTS[parts.first - COMPAT_JAMO_BASE];
     }
+  }
+  return table;
+}();
 
-    return utf8;
+// Writes code as normalize() spells it and returns the bytes written.
+static inline size_t encodeJamo(uint32_t code, char* out) {
+  const JamoParts* parts = nullptr;
+  if (code - CONJOINING_JAMO_BASE < CONJOINING_JAMO_PARTS.size()) {
+    parts = &CONJOINING_JAMO_PARTS[code - CONJOINING_JAMO_BASE];
+  } else if (code - COMPAT_JAMO_BASE < COMPAT_JAMO_PARTS.size()) {
+    parts = &COMPAT_JAMO_PARTS[code - COMPAT_JAMO_BASE];
+  } else {
+    return encodeUtf8(code, out);
+  }
+  const size_t written = encodeUtf8(parts->first, out);
+  return parts->second ? written + encodeUtf8(parts->second, out + written) : written;
 }
 
+static constexpr uint32_t HANGUL_SYLLABLES_START = 0xAC00;
+static constexpr uint32_t HANGUL_SYLLABLES_END = 0xD7A3;
 
-static inline std::string utf16ToUtf8(std::wstring_view utf16) {
-  return utf16ToUtf8(std::wstring(utf16));
+// Bytes normalize() writes at most for `bytes` bytes of input. A syllable
+// takes 3 bytes and can come out as six jamo of 3 bytes each; one cut short
+// at the end of the input takes fewer.
+static inline size_t normalizedCapacity(size_t bytes) {
+  return 6 * (bytes + 2);
 }
 
-class LiteralManager {
-public:
-    std::wstring_view getLiteral(const std::string& word) {
-        std::wstring utf16Word = utf8ToUtf16(word);
-        literals.push_back(std::move(utf16Word));
-        return literals.back();
-    }
-
-    std::deque<std::wstring> literals;
-};
+// The same for shorten(), which keeps at most two jamo of a syllable.
+static inline size_t shortenedCapacity(size_t bytes) {
+  return 2 * (bytes + 2);
+}
 
-static inline std::vector<uint32_t> utf8ToCodepoints(const std::string& utf8) {
-  std::vector<uint32_t> codepoints;
+// Lowercases ascii, decomposes Hangul syllables into jamo and spells jamo as
+// described above, writing the UTF-8 result to out, which must hold
+// normalizedCapacity(word.size()) bytes. Returns the bytes written. Ascii
+// runs are lowercased 8 bytes at a time.
+static inline size_t normalize(std::string_view word, char* out) {
+  constexpr uint64_t ONES = 0x0101010101010101;
+  char* const start = out;
   size_t i = 0;
-  while (i < utf8.size()) {
-      uint32_t codepoint = 0;
-      unsigned char c = utf8[i];
-      if (c < 0x80) {
-          codepoint = c;
-          i += 1;
-      } else if (c < 0xE0) {
-          codepoint = ((c & 0x1F) << 6) | (utf8[i + 1] & 0x3F);
-          i += 2;
-      } else if (c < 0xF0) {
-          codepoint = ((c & 0x0F) << 12) | ((utf8[i + 1] & 0x3F) << 6) | (utf8[i + 2] & 0x3F);
-          i += 3;
-      } else {
-          codepoint = ((c & 0x07) << 18) | ((utf8[i + 1] & 0x3F) << 12) | ((utf8[i + 2] & 0x3F) << 6) | (utf8[i + 3] & 0x3F);
-          i += 4;
+  while (i < word.size()) {
+    uint64_t chunk;
+    if (i + 8 <= word.size() && isAscii8(word.data() + i, chunk)) {
+      // Adding 0x3F carries into the high bit of the bytes from 'A' up and
+      // adding 0x25 into those past 'Z'; no byte carries into the next.
+      const uint64_t upper = (chunk + 0x3F * ONES) & ~(chunk + 0x25 * ONES) & (0x80 * ONES);
+      chunk |= upper >> 2;
+      std::memcpy(out, &chunk, sizeof(chunk));
+      out += 8;
+      i += 8;
+      continue;
+    }
+    const uint32_t code = decodeUtf8(word, i);
+    if (code < 0x80) {
+      *out++ = static_cast<char>(code >= 'A' && code <= 'Z' ? code - 'A' + 'a' : code);
+    } else if (code >= HANGUL_SYLLABLES_START && code <= HANGUL_SYLLABLES_END) {
+      const uint32_t offset = code - HANGUL_SYLLABLES_START;
+      out += encodeJamo(CONJOINING_JAMO_BASE + offset / (21 * 28), out);
+      out += encodeJamo(CONJOINING_JAMO_BASE + 0x61 + offset % (21 * 28) / 28, out);
+      if (offset % 28 != 0) {
+        out += encodeJamo(CONJOINING_JAMO_BASE + 0xA7 + offset % 28, out);
       }
-      codepoints.push_back(codepoint);
+    } else {
+      out += encodeJamo(code, out);
+    }
   }
-  return codepoints;
+  return out - start;
 }
 
-static inline std::string codepointToUtf8(char32_t codepoint) {
-    std::string utf8_string;
+// normalize() into buffer, whose capacity is kept for the next call.
+static inline std::string_view normalize(std::string_view word, std::string& buffer) {
+  buffer.resize(normalizedCapacity(word.size()));
+  return std::string_view(buffer.data(), normalize(word, buffer.data()));
+}
 
-    if (codepoint <= 0x7F) {
-      utf8_string += static_cast<char>(codepoint);
-    } else if (codepoint <= 0x7FF) {
-      utf8_string += static_cast<char>(0xC0 | ((codepoint >> 6) & 0x1F));
-      utf8_string += static_cast<char>(0x80 | (codepoint & 0x3F));
-    } else if (codepoint <= 0xFFFF) {
-      utf8_string += static_cast<char>(0xE0 | ((codepoint >> 12) & 0x0F));
-      utf8_string += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
-      utf8_string += static_cast<char>(0x80 | (codepoint & 0x3F));
-    } else if (codepoint <= 0x10FFFF) {
-      utf8_string += static_cast<char>(0xF0 | ((codepoint >> 18) & 0x07));
-      utf8_string += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
-      utf8_string += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
-      utf8_string += static_cast<char>(0x80 | (codepoint & 0x3F));
-    }
+static inline std::string normalize(std::string_view word) {
+  std::string result;
+  result.resize(normalize(word, result).size());
+  return result;
+}
 
-    return utf8_string;
+// normalize() straight to utf-16, as queries are searched.
+static inline std::u16string normalizeUtf16(std::string_view word) {
+  thread_local std::string buffer;
+  return utf8ToUtf16(normalize(word, buffer));
 }
 
-static inline int lconToCjamo(int ch) {
-    static const std::vector<int> table = {
-        0x3131, 0x3132, 0x3134, 0x3137, 0x3138, 0x3139, 0x3141, 0x3142,
-        0x3143, 0x3145, 0x3146, 0x3147, 0x3148, 0x3149, 0x314a, 0x314b,
-        0x314c, 0x314d, 0x314e
-    };
-    if (ch < 0x1100 || ch > 0x1112) {
-        if (ch == 0x1140) return 0x317f;
-        else if (ch == 0x114C) return 0x3181;
-        else if (ch == 0x1159) return 0x3186;
-        return ch;
+// The initials of word into out, which must hold
+// shortenedCapacity(word.size()) bytes: the initial jamo of each Hangul syllable if there is
+// one, and otherwise the first lowercase letter of each space separated word
+// followed by a space. Returns the bytes written.
+static inline size_t shorten(std::string_view word, char* out) {
+  char* const start = out;
+  bool containsKorean = false;
+  for (size_t i = 0; i < word.size() && !containsKorean;) {
+    const uint32_t codepoint = decodeUtf8(word, i);
+    containsKorean = codepoint >= HANGUL_SYLLABLES_START && codepoint <= HANGUL_SYLLABLES_END;
+  }
+  bool newWord = true;
+  for (size_t i = 0; i < word.size();) {
+    const uint32_t codepoint = decodeUtf8(word, i);
+    if (containsKorean) {
+      if (codepoint >= HANGUL_SYLLABLES_START && codepoint <= HANGUL_SYLLABLES_END) {
+        out += encodeJamo(CONJOINING_JAMO_BASE + (codepoint - HANGUL_SYLLABLES_START) / (21 * 28), out);
+      }
+    } else if (codepoint <= 0xFF && std::isspace(codepoint)) {
+      newWord = true;
+    } else if (newWord && codepoint >= 'a' && codepoint <= 'z') {
+      *out++ = static_cast<char>(codepoint);
+      *out++ = ' ';
+      newWord = false;
     }
-    return table[ch - 0x1100];
+  }
+  return out - start;
 }
 
-static inline int mvowToCjamo(int ch) {
-    static const std::vector<int> table = {
-        0x314f, 0x3150, 0x3151, 0x3152, 0x3153, 0x3154, 0x3155, 0x3156,
-        0x3157, 0x3158, 0x3159, 0x315a, 0x315b, 0x315c, 0x315d, 0x315e,
-        0x315f, 0x3160, 0x3161, 0x3162, 0x3163
-    };
-    if (ch < 0x1161 || ch > 0x1175) {
-        if (ch == 0x119E) return 0x318D;
-        return ch;
-    }
-    return table[ch - 0x1161];
+// shorten() into buffer, whose capacity is kept for the next call.
+static inline std::string_view shorten(std::string_view word, std::string& buffer) {
+  buffer.resize(shortenedCapacity(word.size()));
+  return std::string_view(buffer.data(), shorten(word, buffer.data()));
 }
 
-static inline int fconToCjamo(int ch) {
-    static const std::vector<int> table = {
-        0x3131, 0x3132, 0x3133, 0x3134, 0x3135, 0x3136, 0x3137, 0x3139,
-        0x313a, 0x313b, 0x313c, 0x313d, 0x313e, 0x313f, 0x3140, 0x3141,
-        0x3142, 0x3144, 0x3145, 0x3146, 0x3147, 0x3148, 0x314a, 0x314b,
-        0x314c, 0x314d, 0x314e
-    };
-    if (ch < 0x11a8 || ch > 0x11c2) {
-        if (ch == 0x11EB) return 0x317f;
-        else if (ch == 0x11F0) return 0x3181;
-        else if (ch == 0x11F9) return 0x3186;
-        return ch;
-    }
-    return table[ch - 0x11a8];
-}
-
-static inline std::string normalizeJamo(uint32_t code) {
-  code = lconToCjamo(code);
-  code = mvowToCjamo(code);
-  code = fconToCjamo(code);
-
-  static const std::unordered_map<std::string, std::string> _complexJamo = {
-    {"ㅘ", "ㅗㅏ"}, {"ㅙ", "ㅗㅐ"}, {"ㅚ", "ㅗㅣ"}, {"ㅝ", "ㅜㅓ"},
-    {"ㅞ", "ㅜㅔ"}, {"ㅟ", "ㅜㅣ"}, {"ㅢ", "ㅡㅣ"},
-    {"ㄳ", "ㄱㅅ"}, {"ㄵ", "ㄴㅈ"}, {"ㄶ", "ㄴㅎ"}, {"ㄺ", "ㄹㄱ"},
-    {"ㄻ", "ㄹㅁ"}, {"ㄼ", "ㄹㅂ"}, {"ㄽ", "ㄹㅅ"}, {"ㄾ", "ㄹㅌ"},
-    {"ㄿ", "ㄹㅍ"}, {"ㅀ", "ㄹㅎ"}, {"ㅄ", "ㅂㅅ"},
-    {"ㄲ", "ㄱㄱ"}, {"ㄸ", "ㄷㄷ"}, {"ㅃ", "ㅂㅂ"}, {"ㅆ", "ㅅㅅ"}, {"ㅉ", "ㅈㅈ"}
-  };
-  static const std::unordered_map<uint32_t, std::string> complexJamo = [] {
-    std::unordered_map<uint32_t, std::string> result;
-    for (const auto& [key, value] : _complexJamo) {
-      const uint32_t code = utf8ToCodepoints(key)[0];
-      result[code] = value;
-    }
-    return result;
-  }();
+static inline std::string shorten(std::string_view word) {
+  std::string result;
+  result.resize(shorten(word, result).size());
+  return result;
+}
 
-  if (complexJamo.find(code) != complexJamo.end()) {
-    return complexJamo.at(code);
+
+// Maps a normalized code unit to one of 64 signature bits. Lowercase ascii
+// and the basic jamo left after normalize() get their own bit, digits and
+// everything else are folded together. A collision only weakens the filter,
+// it never drops a match.
+static inline int signatureBit(char16_t ch) {
+  if (ch >= 'a' && ch <= 'z') {
+    return ch - 'a';
+  }
+  if (ch >= '0' && ch <= '9') {
+    return 26 + (ch - '0') % 5;
+  }
+  if (ch >= 0x3131 && ch <= 0x3163) {
+    static const std::array<int, 0x3163 - 0x3131 + 1> table = [] {
+      const std::u16string_view basic = u"ㄱㄴㄷㄹㅁㅂㅅㅇㅈㅊㅋㅌㅍㅎㅏㅐㅑㅒㅓㅔㅕㅖㅗㅛㅜㅠㅡㅣ";
+      std::array<int, 0x3163 - 0x3131 + 1> result{};
+      for (size_t i = 0; i < result.size(); i++) {
+        result[i] = 31 + i % basic.size();
+      }
+      for (size_t i = 0; i < basic.size(); i++) {
+        result[basic[i] - 0x3131] = 31 + i;
+      }
+      return result;
+    }();
+    return table[ch - 0x3131];
   }
-  return codepointToUtf8(code);
+  return 59 + ch % 5;
 }
 
-static inline std::string normalize(const std::string& word) {
-  std::string result;
-  std::vector<uint32_t> codepoints = utf8ToCodepoints(word);
+static inline uint64_t calcSignature(std::u16string_view str) {
+  uint64_t signature = 0;
+  for (char16_t ch : str) {
+    signature |= uint64_t(1) << signatureBit(ch);
+  }
+  return signature;
+}
 
-  const auto append = [&](const std::string& str) {
-    auto codepoints = utf8ToCodepoints(str);
-    for (uint32_t code : codepoints) {
-      result += normalizeJamo(code);
-    }
-  };
+struct PostingList {
+  const uint32_t* first;
+  const uint32_t* last;
 
-  for (uint32_t code : codepoints) {
-    if (code >= 'A' && code <= 'Z') {
-      result.push_back(code - 'A' + 'a');
-    } else if ((code >= 'a' && code <= 'z') || (code >= '0' && code <= '9')) {
-      result.push_back(code);
-    } else if (code >= 0xAC00 && code <= 0xD7A3) {
-      int code_offset = code - 0xAC00;
-      int initial = code_offset / (21 * 28);
-      int medial = (code_offset % (21 * 28)) / 28;
-      int final = code_offset % 28;
-
-      static const std::vector<std::string> initialJamos = {
-        "ㄱ", "ㄲ", "ㄴ", "ㄷ", "ㄸ", "ㄹ", "ㅁ", "ㅂ", "ㅃ", "ㅅ",
-        "ㅆ", "ㅇ", "ㅈ", "ㅉ", "ㅊ", "ㅋ", "ㅌ", "ㅍ", "ㅎ"
-      };
-      static const std::vector<std::string> medialJamos = {
-        "ㅏ", "ㅐ", "ㅑ", "ㅒ", "ㅓ", "ㅔ", "ㅕ", "ㅖ", "ㅗ", "ㅘ",
-        "ㅙ", "ㅚ", "ㅛ", "ㅜ", "ㅝ", "ㅞ", "ㅟ", "ㅠ", "ㅡ", "ㅢ", "ㅣ"
-      };
-      static const std::vector<std::string> finalJamos = {
-        "", "ㄱ", "ㄲ", "ㄳ", "ㄴ", "ㄵ", "ㄶ", "ㄷ", "ㄹ", "ㄺ",
-        "ㄻ", "ㄼ", "ㄽ", "ㄾ", "ㄿ", "ㅀ", "ㅁ", "ㅂ", "ㅄ", "ㅅ",
-        "ㅆ", "ㅇ", "ㅈ", "ㅊ", "ㅋ", "ㅌ", "ㅍ", "ㅎ"
-      };
+  const uint32_t* begin() const {
+    return first;
+  }
 
-      append(initialJamos[initial]);
-      append(medialJamos[medial]);
-      if (final != 0) {
-        append(finalJamos[final]);
-      }
-    } else {
-      append(codepointToUtf8(code));
-    }
+  const uint32_t* end() const {
+    return last;
   }
-  return result;
-}
+};
 
-static inline std::string shorten(const std::string& word) {
-  std::string result;
-  std::vector<uint32_t> codepoints = utf8ToCodepoints(word);
+// Prefilter over the normalized column. A row can only contain the query as
+// a subsequence if its signature covers the query's signature, and if the
+// query has a rare character only the rows in that character's posting list
+// need to be looked at. Posting lists are in row order so the scan visits
+// candidates in the same order as a full scan would. Everything is stored in
+// flat arrays so the index can be written to and read from a snapshot as is.
+class SearchIndex {
+public:
+  static constexpr size_t RARE_CHAR_RATIO = 8;
 
-  const uint32_t HANGUL_SYLLABLES_START = 0xAC00;
-  const uint32_t HANGUL_SYLLABLES_END = 0xD7A3;
-  const uint32_t CHOSUNG_BASE = 0x1100;
+  std::vector<uint64_t> signatures;
+  // Posting lists of rare characters in CSR form: the rows of rareChars[i]
+  // are postingIds[postingOffsets[i], postingOffsets[i + 1]).
+  std::vector<char16_t> rareChars;
+  std::vector<uint32_t> postingOffsets;
+  std::vector<uint32_t> postingIds;
+  // Bitmap of every code unit that appears in some row.
+  std::vector<uint64_t> presentChars;
+  // Rows covered by the posting lists. Rows appended after build() have a
+  // signature but are only found by scanning them.
+  uint32_t indexedRows = 0;
 
-  bool containsKorean = false;
-  for (uint32_t codepoint : codepoints) {
-    if (codepoint >= HANGUL_SYLLABLES_START && codepoint <= HANGUL_SYLLABLES_END) {
-      containsKorean = true;
-      break;
-    }
+  void clear() {
+    indexedRows = 0;
+    signatures.clear();
+    rareChars.clear();
+    postingOffsets.clear();
+    postingIds.clear();
+    presentChars.clear();
   }
 
-  if (containsKorean) {
-    for (uint32_t codepoint : codepoints) {
-      if (codepoint >= HANGUL_SYLLABLES_START && codepoint <= HANGUL_SYLLABLES_END) {
-        uint32_t chosungIndex = (codepoint - HANGUL_SYLLABLES_START) / (21 * 28);
-        uint32_t chosungCodepoint = CHOSUNG_BASE + chosungIndex;
-        result += normalizeJamo(chosungCodepoint);
+  void build(const StringColumn& normalized) {
+    clear();
+    signatures.reserve(normalized.size());
+    presentChars.assign(0x10000 / 64, 0);
+    // Code units are utf-16, so a dense table covers every character. lastRow
+    // makes each character count once per row.
+    std::vector<uint32_t> counts(0x10000), lastRow(0x10000, UINT32_MAX);
+    for (uint32_t id = 0; id < normalized.size(); id++) {
+      signatures.push_back(calcSignature(normalized[id]));
+      for (char16_t ch : normalized[id]) {
+        if (lastRow[ch] != id) {
+          lastRow[ch] = id;
+          counts[ch]++;
+        }
       }
     }
-  } else {
-    bool newWord = true;
-    for (uint32_t c : codepoints) {
-      if (std::isspace(c)) {
-        newWord = true;
-      } else if (newWord && c >= 'a' && c <= 'z') {
-        result += c;
-        result += ' ';
-        newWord = false;
+    const size_t rareLimit = normalized.size() / RARE_CHAR_RATIO;
+    // Reuse lastRow as the write cursor of each rare character's list.
+    std::vector<uint32_t>& cursor = lastRow;
+    postingOffsets.push_back(0);
+    for (uint32_t ch = 0; ch < counts.size(); ch++) {
+      if (counts[ch] == 0) {
+        continue;
+      }
+      presentChars[ch / 64] |= uint64_t(1) << (ch % 64);
+      if (counts[ch] <= rareLimit) {
+        cursor[ch] = postingOffsets.back();
+        rareChars.push_back(ch);
+        postingOffsets.push_back(postingOffsets.back() + counts[ch]);
+      } else {
+        cursor[ch] = UINT32_MAX;
+      }
+    }
+    postingIds.resize(postingOffsets.back());
+    std::vector<uint32_t>& seenRow = counts;
+    std::fill(seenRow.begin(), seenRow.end(), UINT32_MAX);
+    for (uint32_t id = 0; id < normalized.size(); id++) {
+      for (char16_t ch : normalized[id]) {
+        if (cursor[ch] == UINT32_MAX || seenRow[ch] == id) {
+          continue;
+        }
+        seenRow[ch] = id;
+        postingIds[cursor[ch]++] = id;
       }
     }
+    indexedRows = normalized.size();
   }
-  return result;
-}
 
+  // Adds a row without rebuilding the posting lists.
+  void append(std::u16string_view normalized) {
+    signatures.push_back(calcSignature(normalized));
+    if (presentChars.empty()) {
+      presentChars.assign(0x10000 / 64, 0);
+    }
+    for (char16_t ch : normalized) {
+      presentChars[ch / 64] |= uint64_t(1) << (ch % 64);
+    }
+  }
 
-class Database {
-public:
-  std::string name;
-  LiteralManager lieteralManager;
-  std::vector<Word> words;
-  Database(const std::string& name) : name(name) {}
-  void load(const std::string& csvData) {
-    words.clear();
-    lieteralManager.literals.clear();
-    std::istringstream iss(csvData);
-    std::string line;
-    while (std::getline(iss, line)) {
-      std::istringstream lineStream(line);
-      std::string word, redirect;
-      int64_t freq, category;
-      std::getline(lineStream, word, ',');
-      lineStream >> category;
-      lineStream.ignore(1, ',');
-      lineStream >> freq;
-      lineStream.ignore(1, ',');
-      std::getline(lineStream, redirect);
-      if (word.size() > MAX_WORD_LEN || redirect.size() > MAX_WORD_LEN) {
+  // Returns the shortest posting list among the query's characters, or
+  // nothing when none of them is rare and every row has to be visited. A
+  // character that appears in no row at all yields an empty list.
+  std::optional<PostingList> candidates(std::u16string_view query) const {
+    std::optional<PostingList> best;
+    for (char16_t ch : query) {
+      if (presentChars.empty() || !(presentChars[ch / 64] >> (ch % 64) & 1)) {
+        return PostingList{nullptr, nullptr};
+      }
+      const size_t i = rareIndex(ch);
+      if (i == rareChars.size()) {
         continue;
       }
-      words.emplace_back(getLiteral(normalize(word)), getLiteral(shorten(word)), getLiteral(word), getLiteral(redirect), freq, category, 0);
+      const PostingList list{postingIds.data() + postingOffsets[i], postingIds.data() + postingOffsets[i + 1]};
+      if (!best || list.last - list.first < best->last - best->first) {
+        best = list;
+      }
     }
+    return best;
   }
 
-  std::wstring_view getLiteral(const std::string& word) {
-    return lieteralManager.getLiteral(word);
+  size_t bytes() const {
+    return signatures.capacity() * sizeof(uint64_t) + rareChars.capacity() * sizeof(char16_t) +
+           postingOffsets.capacity() * sizeof(uint32_t) + postingIds.capacity() * sizeof(uint32_t) +
+           presentChars.capacity() * sizeof(uint64_t);
   }
 
-  inline static bool isSubsequence(std::wstring_view small, std::wstring_view large) {
-    int i = 0, j = 0;
-    while (i < small.size() && j < large.size()) {
-      if (small[i] == large[j]) {
-        i++;
-      }
+private:
+  size_t rareIndex(char16_t ch) const {
+    auto it = std::lower_bound(rareChars.begin(), rareChars.end(), ch);
+    return it != rareChars.end() && *it == ch ? it - rareChars.begin() : rareChars.size();
+  }
+};
+
+// Compares a and b with spaces skipped, from the back when reversed. With
+// prefix, a compares equal to b whenever b runs out first.
+static inline int comparePacked(std::u16string_view a, std::u16string_view b, bool reversed, bool prefix) {
+  const auto at = [&](std::u16string_view s, size_t k) {
+    return reversed ? s[s.size() - 1 - k] : s[k];
+  };
+  size_t i = 0, j = 0;
+  while (true) {
+    while (i < a.size() && at(a, i) == u' ') {
+      i++;
+    }
+    while (j < b.size() && at(b, j) == u' ') {
       j++;
     }
-    return i == small.size();
+    if (j == b.size()) {
+      return i == a.size() || prefix ? 0 : 1;
+    }
+    if (i == a.size()) {
+      return -1;
+    }
+    const char16_t x = at(a, i++), y = at(b, j++);
+    if (x != y) {
+      return x < y ? -1 : 1;
+    }
   }
+}
 
-  std::vector<Word> search(const std::string& word) {
-    const std::wstring normalized = utf8ToUtf16(normalize(word));
-    std::vector<Word> result_;
-    std::unordered_set<std::wstring_view> seen;
-    for (const auto& item : words) {
-      if (isSubsequence(normalized, item.normalized)) {
-        if (item.redirect == L"null")
-          seen.insert(item.word);
-        result_.push_back(item);
-      }
-      if (result_.size() >= INITIAL_CUTOFF) {
-        break;
+// Index over the shortened column: the rows sorted by their initials with
+// the spaces between English initials dropped, read forward and backward.
+// The rows whose initials begin or end with a query are two ranges found by
+// binary search, so abbreviation queries like "ㄱㅂ" or "bh" reach their
+// rows without scanning. Rows appended after build() are not covered.
+class InitialsIndex {
+public:
+  std::vector<uint32_t> byPrefix;
+  std::vector<uint32_t> bySuffix;
+
+  void clear() {
+    byPrefix.clear();
+    bySuffix.clear();
+  }
+
+  // Rows with the same initials stay in row order.
+  template <class Shortened>
+  void build(uint32_t rows, Shortened shortened) {
+    // Sorting on the first four initials packed into an integer leaves few
+    // ties for comparePacked() to settle.
+    std::vector<std::pair<uint64_t, uint32_t>> keyed(rows);
+    for (bool reversed : {false, true}) {
+      for (uint32_t id = 0; id < rows; id++) {
+        const std::u16string_view text = shortened(id);
+        uint64_t key = 0;
+        int units = 0;
+        for (size_t k = 0; k < text.size() && units < 4; k++) {
+          const char16_t ch = text[reversed ? text.size() - 1 - k : k];
+          if (ch != u' ') {
+            key |= uint64_t(ch) << (48 - 16 * units++);
+          }
+        }
+        keyed[id] = {key, id};
       }
-    }
-    std::vector<Word> result;
-    for (const auto& item : result_) {
-      if (item.redirect == L"null" || seen.find(item.redirect) == seen.end()) {
-        result.push_back(item);
+      std::sort(keyed.begin(), keyed.end(), [&](const auto& a, const auto& b) {
+        if (a.first != b.first) {
+          return a.first < b.first;
+        }
+        const int order = a.first & 0xffff ? comparePacked(shortened(a.second), shortened(b.second), reversed, false) : 0;
+        return order != 0 ? order < 0 : a.second < b.second;
+      });
+      std::vector<uint32_t>& sorted = reversed ? bySuffix : byPrefix;
+      sorted.resize(rows);
+      for (uint32_t i = 0; i < rows; i++) {
+        sorted[i] = keyed[i].second;
       }
     }
-    std::vector<std::tuple<int,int,int,int>> scores;
-    for (const auto& item : result) {
-      scores.push_back({calcGapMatch(normalized, item.shortened), calcGapMatch(normalized, item.normalized), -item.priority, -item.freq});
-    }
-    std::vector<int> idx(result.size());
-    std::iota(idx.begin(), idx.end(), 0);
-    std::sort(idx.begin(), idx.end(), [&](int i, int j) {
-      return scores[i] < scores[j];
-    });
-    std::vector<Word> sortedResult;
-    for (int i = 0; i < std::min((int)result.size(), FINAL_CUTOF); i++) {
-      sortedResult.push_back(result[idx[i]]);
+  }
+
+  uint32_t rows() const {
+    return byPrefix.size();
+  }
+
+  // Appends the rows whose initials begin or end with query; a row can come
+  // twice.
+  template <class Shortened>
+  void find(std::u16string_view query, Shortened shortened, std::vector<uint32_t>& out) const {
+    for (bool reversed : {false, true}) {
+      const std::vector<uint32_t>& sorted = reversed ? bySuffix : byPrefix;
+      const auto first = std::partition_point(sorted.begin(), sorted.end(), [&](uint32_t id) {
+        return comparePacked(shortened(id), query, reversed, true) < 0;
+      });
+      const auto last = std::partition_point(first, sorted.end(), [&](uint32_t id) {
+        return comparePacked(shortened(id), query, reversed, true) == 0;
+      });
+      out.insert(out.end(), first, last);
     }
-    return sortedResult;
+  }
+
+  size_t bytes() const {
+    return (byPrefix.capacity() + bySuffix.capacity()) * sizeof(uint32_t);
   }
 };
 
-class DatabaseRepository {
-public:
-  std::map<int, std::unique_ptr<Database>> databases;
-  int nextId = 0;
-  DatabaseRepository() = default;
-  void create(const std::string& name) {
-    databases[nextId] = std::make_unique<Database>(name);
-    nextId++;
+struct MemoryUsage {
+  size_t rows = 0;
+  size_t normalizedBytes = 0;
+  size_t stringBytes = 0;
+  size_t recordBytes = 0;
+  size_t indexBytes = 0;
+
+  size_t totalBytes() const {
+    return normalizedBytes + stringBytes + recordBytes + indexBytes;
+  }
+
+  // Bytes a full scan reads: the normalized column and the row signatures.
+  size_t scanBytes() const {
+    return normalizedBytes + rows * sizeof(uint64_t);
+  }
+
+  std::vector<std::pair<std::string, double>> fields() const {
+    return {
+      {"rows", double(rows)},
+      {"normalizedBytes", double(normalizedBytes)},
+      {"stringBytes", double(stringBytes)},
+      {"recordBytes", double(recordBytes)},
+      {"indexBytes", double(indexBytes)},
+      {"totalBytes", double(totalBytes())},
+      {"scanBytes", double(scanBytes())},
+    };
+  }
+};
+
+static inline std::string toJson(const std::vector<std::pair<std::string, double>>& fields) {
+  std::ostringstream out;
+  out << "{";
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (i > 0) {
+      out << ",";
+    }
+    out << "\"" << fields[i].first << "\":" << std::setprecision(15) << fields[i].second;
   }
-  Database& get(int id) {
-    return *databases[id];
+  out << "}";
+  return out.str();
+}
+
+// 64-bit FNV-style hash over 8-byte words, used to fingerprint the CSV a
+// snapshot was built from and to checksum the snapshot payload.
+static inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+  const char* bytes = static_cast<const char*>(data);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, 8);
+    hash = (hash ^ word) * 0x100000001b3ULL;
+    hash ^= hash >> 29;
   }
-  void release(int id) {
-    databases.erase(id);
+  for (; i < size; i++) {
+    hash = (hash ^ uint8_t(bytes[i])) * 0x100000001b3ULL;
   }
+  return hash;
+}
+
+static inline uint64_t sourceHash(const std::string& source) {
+  return hashBytes(source.data(), source.size());
+}
+
+// Read-only view of a whole file.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      return;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+      return;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+      return;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+      return;
+    }
+    ptr = static_cast<const char*>(view);
+    length = fileSize.QuadPart;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (view != MAP_FAILED) {
+        ptr = static_cast<const char*>(view);
+        length = st.st_size;
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (ptr) {
+      UnmapViewOfFile(ptr);
+    }
+    if (mapping) {
+      CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+      CloseHandle(file);
+    }
+#else
+    if (ptr) {
+      munmap(const_cast<char*>(ptr), length);
+    }
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const {
+    return ptr;
+  }
+
+  size_t size() const {
+    return length;
+  }
+
+private:
+  const char* ptr = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#endif
+};
+
+// Binary image of a loaded database. The header is followed by a sequence of
+// sections, each a 64-bit byte length and the raw contents of one column or
+// index array, padded to 8 bytes. Loading only checks the header and
+// checksum and copies the sections back, nothing is parsed or normalized.
+struct SnapshotHeader {
+  static constexpr uint32_t VERSION = 6;
+  static constexpr uint32_t ENDIAN_MARK = 0x01020304;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t recordSize;
+  uint32_t rows;
+  uint64_t sourceHash;
+  uint64_t payloadHash;
+  uint64_t payloadSize;
+};
+
+class SnapshotWriter {
+public:
+  std::string payload;
+
+  template <typename T>
+  void write(const std::vector<T>& items) {
+    const uint64_t size = items.size() * sizeof(T);
+    payload.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    payload.append(reinterpret_cast<const char*>(items.data()), size);
+    payload.append((8 - size % 8) % 8, '\0');
+  }
+};
+
+class SnapshotReader {
+public:
+  SnapshotReader(const char* data, size_t size) : data(data), size(size) {}
+
+  template <typename T>
+  bool read(std::vector<T>& items) {
+    uint64_t bytes;
+    if (size - pos < sizeof(bytes)) {
+      return false;
+    }
+    std::memcpy(&bytes, data + pos, sizeof(bytes));
+    pos += sizeof(bytes);
+    const uint64_t padded = bytes + (8 - bytes % 8) % 8;
+    if (bytes % sizeof(T) != 0 || size - pos < padded) {
+      return false;
+    }
+    items.resize(bytes / sizeof(T));
+    std::memcpy(items.data(), data + pos, bytes);
+    pos += padded;
+    return true;
+  }
+
+  bool done() const {
+    return pos == size;
+  }
+
+private:
+  const char* data;
+  size_t size;
+  size_t pos = 0;
+};
+
+// One line of db.csv: word,category,freq,redirect. Numbers are read the way
+// operator>> reads them (leading whitespace, optional sign). When a number
+// does not parse, it and everything after it is left at 0 or empty.
+struct CsvRow {
+  std::string_view word;
+  std::string_view redirect;
+  int64_t category = 0;
+  int64_t freq = 0;
+};
+
+static inline bool parseInt(std::string_view line, size_t& pos, int64_t& value) {
+  while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos]))) {
+    pos++;
+  }
+  bool negative = false;
+  if (pos < line.size() && (line[pos] == '-' || line[pos] == '+')) {
+    negative = line[pos] == '-';
+    pos++;
+  }
+  if (pos >= line.size() || line[pos] < '0' || line[pos] > '9') {
+    return false;
+  }
+  value = 0;
+  while (pos < line.size() && line[pos] >= '0' && line[pos] <= '9') {
+    value = value * 10 + (line[pos] - '0');
+    pos++;
+  }
+  if (negative) {
+    value = -value;
+  }
+  return true;
+}
+
+static inline CsvRow parseCsvLine(std::string_view line) {
+  CsvRow row;
+  const size_t comma = line.find(',');
+  row.word = line.substr(0, comma);
+  if (comma == std::string_view::npos) {
+    return row;
+  }
+  size_t pos = comma + 1;
+  if (!parseInt(line, pos, row.category)) {
+    row.category = 0;
+    return row;
+  }
+  pos++;
+  if (!parseInt(line, pos, row.freq)) {
+    row.freq = 0;
+    return row;
+  }
+  pos++;
+  row.redirect = line.substr(std::min(pos, line.size()));
+  return row;
+}
+
+// Rows parsed and normalized by one loader thread. String refs point into
+// the chunk's own arena until the chunks are merged.
+struct LoadChunk {
+  StringColumn normalized;
+  Utf8Column utf8;
+  StringArena strings;
+  std::vector<WordRecord> records;
+  std::vector<std::string_view> redirects;
+
+  // Parses the CSV lines [first, last), skipping rows with an over-long
+  // field.
+  void parse(const std::string_view* first, const std::string_view* last) {
+    // Conversion buffers, reused from row to row.
+    std::string normalizedBuffer, shortenedBuffer;
+    std::u16string units;
+    for (; first != last; ++first) {
+      const CsvRow row = parseCsvLine(*first);
+      if (row.word.size() > MAX_WORD_LEN || row.redirect.size() > MAX_WORD_LEN) {
+        continue;
+      }
+      const std::string_view normalizedWord = normalize(row.word, normalizedBuffer);
+      const std::string_view shortenedWord = shorten(row.word, shortenedBuffer);
+      normalized.push_back(utf8ToUtf16(normalizedWord, units));
+      utf8.push_back(normalizedWord);
+      utf8.push_back(shortenedWord);
+      utf8.push_back(row.word);
+      const StringRef shortenedRef = strings.add(utf8ToUtf16(shortenedWord, units));
+      const StringRef wordRef = strings.add(utf8ToUtf16(row.word, units));
+      records.push_back({shortenedRef, wordRef, 0, int32_t(row.category), row.freq, 0});
+      redirects.push_back(row.redirect);
+    }
+  }
+};
+
+// Parses the lines [first, last) in `threads` equal runs, one on the calling
+// thread, and appends a chunk per run to chunks in line order.
+static inline void parseLines(const std::string_view* first, const std::string_view* last, size_t threads, std::vector<LoadChunk>& chunks) {
+  const size_t base = chunks.size();
+  const size_t count = last - first;
+  chunks.resize(base + threads);
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; i++) {
+    workers.emplace_back([&, i] { chunks[base + i].parse(first + count * i / threads, first + count * (i + 1) / threads); });
+  }
+  chunks[base].parse(first, first + count / threads);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+// The non-empty lines of text, without their '\n', in order. The views
+// point into text.
+static inline std::vector<std::string_view> splitCsvLines(std::string_view text) {
+  std::vector<std::string_view> lines;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find('\n', start);
+    if (end == std::string_view::npos) {
+      end = text.size();
+    }
+    if (end > start) {
+      lines.push_back(text.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  return lines;
+}
+
+// Reorders lines into tiers of equal freq from the highest down; lines of
+// one tier keep their order. A scan in this order meets the rows that win
+// ties in rank() first, so the scan budget keeps the best matches and the
+// bounds let it stop early.
+static inline void orderByFrequency(std::vector<std::string_view>& lines) {
+  struct Line {
+    int64_t freq;
+    std::string_view text;
+  };
+  std::vector<Line> keyed;
+  keyed.reserve(lines.size());
+  for (const std::string_view line : lines) {
+    keyed.push_back({parseCsvLine(line).freq, line});
+  }
+  std::stable_sort(keyed.begin(), keyed.end(), [](const Line& a, const Line& b) { return a.freq > b.freq; });
+  for (size_t i = 0; i < keyed.size(); i++) {
+    lines[i] = keyed[i].text;
+  }
+}
+
+struct LoadStats {
+  size_t rows = 0;
+  size_t bytes = 0;
+  size_t threads = 0;
+  // Distinct redirect targets that no loaded row has.
+  size_t danglingRedirects = 0;
+  bool fromSnapshot = false;
+  // False for the stores loadFile() publishes before its last batch.
+  bool complete = true;
+  uint64_t orderNs = 0;
+  uint64_t splitNs = 0;
+  uint64_t parseNs = 0;
+  uint64_t mergeNs = 0;
+  uint64_t indexNs = 0;
+  uint64_t totalNs = 0;
+
+  double rowsPerSec() const {
+    return totalNs ? rows * 1e9 / totalNs : 0;
+  }
+
+  std::vector<std::pair<std::string, double>> fields() const {
+    return {
+      {"rows", double(rows)},
+      {"bytes", double(bytes)},
+      {"threads", double(threads)},
+      {"danglingRedirects", double(danglingRedirects)},
+      {"fromSnapshot", double(fromSnapshot)},
+      {"complete", double(complete)},
+      {"orderMs", orderNs / 1e6},
+      {"splitMs", splitNs / 1e6},
+      {"parseMs", parseNs / 1e6},
+      {"mergeMs", mergeNs / 1e6},
+      {"indexMs", indexNs / 1e6},
+      {"totalMs", totalNs / 1e6},
+      {"rowsPerSec", rowsPerSec()},
+    };
+  }
+};
+
+static inline uint64_t elapsedNs(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// A fixed set of threads that run the shards of parallel searches. Several
+// searches may share the pool. Each run() posts a job whose tasks are claimed
+// in order through a counter, so an idle worker takes the next shard of any
+// pending job and the calling thread works on its own job too.
+class ThreadPool {
+public:
+  // threads counts the calling thread, so a pool of 1 has no workers.
+  ThreadPool(size_t threads) {
+    for (size_t i = 1; i < threads; i++) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  size_t size() const {
+    return workers.size() + 1;
+  }
+
+  // Calls task(0) .. task(count - 1) and returns when all have finished.
+  void run(size_t count, const std::function<void(size_t)>& task) {
+    auto job = std::make_shared<Job>(count, task);
+    if (!workers.empty()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+      }
+      wake.notify_all();
+    }
+    job->help();
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&] { return job->done == job->count; });
+  }
+
+private:
+  struct Job {
+    size_t count;
+    std::function<void(size_t)> task;
+    std::atomic<size_t> next{0};
+    size_t done = 0;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    Job(size_t count, const std::function<void(size_t)>& task) : count(count), task(task) {}
+
+    // Runs tasks until none are left to claim.
+    void help() {
+      for (size_t i = next++; i < count; i = next++) {
+        task(i);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++done == count) {
+          finished.notify_all();
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  std::deque<std::shared_ptr<Job>> jobs;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  void work() {
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stopping || !jobs.empty(); });
+        if (stopping) {
+          return;
+        }
+        job = jobs.front();
+      }
+      job->help();
+      // Every task of the job has been claimed, so nobody needs to find it
+      // again.
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!jobs.empty() && jobs.front() == job) {
+        jobs.pop_front();
+      }
+    }
+  }
+};
+
+// Lets a caller abandon a search once it has issued a newer one. The search
+// polls cancelled() every few thousand rows.
+class SearchCancel {
+public:
+  SearchCancel(const std::atomic<uint64_t>& latest, uint64_t generation) : latest(latest), generation(generation) {}
+
+  bool cancelled() const {
+    return latest.load(std::memory_order_relaxed) != generation;
+  }
+
+private:
+  const std::atomic<uint64_t>& latest;
+  uint64_t generation;
+};
+
+// Budgets of one search. Each Database has a set, and a query may bring its
+// own.
+struct SearchOptions {
+  // Matches the scan collects before ranking starts.
+  uint32_t scanBudget = 1600;
+  // Rows a search returns.
+  uint32_t resultLimit = 256;
+  // Whether ranking scores the query against the shortened form as well as
+  // the normalized one. Without it ranking does half the calcGapMatch calls.
+  bool scoreShortened = true;
+  // Milliseconds the scan may take, 0 for no limit. Once they are spent the
+  // matches found so far are ranked and returned.
+  uint32_t timeBudgetMs = 0;
+  // Results below which a search also takes rows that hold the query within
+  // a few edits; see appendFuzzy(). 0 never does.
+  uint32_t fuzzyResults = 0;
+  // Most edits such a row may take.
+  uint32_t fuzzyEdits = 2;
+  // Milliseconds the fuzzy pass may take, 0 for no limit.
+  uint32_t fuzzyTimeBudgetMs = 10;
+
+  bool operator==(const SearchOptions& other) const {
+    return scanBudget == other.scanBudget && resultLimit == other.resultLimit && scoreShortened == other.scoreShortened && timeBudgetMs == other.timeBudgetMs &&
+           fuzzyResults == other.fuzzyResults && fuzzyEdits == other.fuzzyEdits && fuzzyTimeBudgetMs == other.fuzzyTimeBudgetMs;
+  }
+
+  bool operator!=(const SearchOptions& other) const {
+    return !(*this == other);
+  }
+
+  std::vector<std::pair<std::string, double>> fields() const {
+    return {
+      {"scanBudget", double(scanBudget)},
+      {"resultLimit", double(resultLimit)},
+      {"scoreShortened", double(scoreShortened)},
+      {"timeBudgetMs", double(timeBudgetMs)},
+      {"fuzzyResults", double(fuzzyResults)},
+      {"fuzzyEdits", double(fuzzyEdits)},
+      {"fuzzyTimeBudgetMs", double(fuzzyTimeBudgetMs)},
+    };
+  }
+};
+
+// Search instrumentation. Building with TAGDB_STATS=0 compiles it out;
+// otherwise a search with stats turned off pays one branch.
+#ifndef TAGDB_STATS
+#define TAGDB_STATS 1
+#endif
+
+// Work done by one search, filled in by collect(), refine() and rank() when
+// they are given one.
+struct SearchCounters {
+  // Rows tested against the query.
+  uint64_t rowsScanned = 0;
+  uint64_t subsequenceHits = 0;
+  // Rows left unscanned, or matches dropped, once scanBudget rows were
+  // collected.
+  uint64_t cutoffRows = 0;
+  // Rows left unscanned because they could not reach the top results.
+  uint64_t boundSkippedRows = 0;
+  // Scans cut short by timeBudgetMs.
+  uint64_t timeouts = 0;
+  // Aliases dropped because their canonical row was collected too.
+  uint64_t redirectsDeduped = 0;
+  uint64_t rowsRanked = 0;
+  // Ranked words too long for calcGapMatch.
+  uint64_t longWords = 0;
+  // Rows collected from the initials index ahead of the scan.
+  uint64_t initialsRows = 0;
+  // Scans skipped because the initials index held the top results.
+  uint64_t initialsOnly = 0;
+  // Rows the fuzzy pass measured the edit distance of, and those close
+  // enough.
+  uint64_t fuzzyRows = 0;
+  uint64_t fuzzyHits = 0;
+  // Fuzzy passes cut short by fuzzyTimeBudgetMs.
+  uint64_t fuzzyTimeouts = 0;
+};
+
+enum class SearchPhase { Normalize, Collect, Rank, Fuzzy, Marshal, Count };
+
+// Counters and per-phase latency histograms of a database's searches.
+// Updated with relaxed atomics from any thread.
+class SearchStats {
+public:
+  // Bucket i counts phases that took [2^i, 2^(i+1)) ns; the last one also
+  // everything slower.
+  static constexpr size_t BUCKETS = 32;
+  static constexpr size_t PHASES = size_t(SearchPhase::Count);
+
+  bool enabled() const {
+    return TAGDB_STATS && on.load(std::memory_order_relaxed);
+  }
+
+  void setEnabled(bool enabled) {
+    on = enabled;
+  }
+
+  void add(const SearchCounters& counters) {
+    const uint64_t values[] = {1, counters.rowsScanned, counters.subsequenceHits, counters.cutoffRows, counters.boundSkippedRows, counters.timeouts, counters.redirectsDeduped, counters.rowsRanked, counters.longWords, counters.initialsRows, counters.initialsOnly, counters.fuzzyRows, counters.fuzzyHits, counters.fuzzyTimeouts};
+    for (size_t i = 0; i < COUNTERS; i++) {
+      totals[i].fetch_add(values[i], std::memory_order_relaxed);
+    }
+  }
+
+  void time(SearchPhase phase, uint64_t ns) {
+    const size_t p = size_t(phase);
+    size_t bucket = 0;
+    while (bucket + 1 < BUCKETS && ns >> (bucket + 1)) {
+      bucket++;
+    }
+    histograms[p][bucket].fetch_add(1, std::memory_order_relaxed);
+    phaseNs[p].fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  void reset() {
+    for (auto& total : totals) {
+      total = 0;
+    }
+    for (size_t p = 0; p < PHASES; p++) {
+      phaseNs[p] = 0;
+      for (auto& count : histograms[p]) {
+        count = 0;
+      }
+    }
+  }
+
+  std::vector<uint64_t> histogram(SearchPhase phase) const {
+    std::vector<uint64_t> counts(BUCKETS);
+    for (size_t i = 0; i < BUCKETS; i++) {
+      counts[i] = histograms[size_t(phase)][i].load(std::memory_order_relaxed);
+    }
+    return counts;
+  }
+
+  static const char* phaseName(SearchPhase phase) {
+    static const char* names[] = {"normalize", "collect", "rank", "fuzzy", "marshal"};
+    return names[size_t(phase)];
+  }
+
+  // The counters, then per phase its count, total time and the upper bounds
+  // of the buckets holding the median and the 99th percentile.
+  std::vector<std::pair<std::string, double>> fields() const {
+    static const char* names[] = {"searches", "rowsScanned", "subsequenceHits", "cutoffRows", "boundSkippedRows", "timeouts", "redirectsDeduped", "rowsRanked", "longWords", "initialsRows", "initialsOnly", "fuzzyRows", "fuzzyHits", "fuzzyTimeouts"};
+    std::vector<std::pair<std::string, double>> result;
+    result.emplace_back("enabled", enabled());
+    for (size_t i = 0; i < COUNTERS; i++) {
+      result.emplace_back(names[i], double(totals[i].load(std::memory_order_relaxed)));
+    }
+    for (size_t p = 0; p < PHASES; p++) {
+      const std::string name = phaseName(SearchPhase(p));
+      const std::vector<uint64_t> counts = histogram(SearchPhase(p));
+      const uint64_t count = std::accumulate(counts.begin(), counts.end(), uint64_t(0));
+      result.emplace_back(name + "Count", double(count));
+      result.emplace_back(name + "Ms", phaseNs[p].load(std::memory_order_relaxed) / 1e6);
+      result.emplace_back(name + "P50Us", percentileUs(counts, count, 0.5));
+      result.emplace_back(name + "P99Us", percentileUs(counts, count, 0.99));
+    }
+    return result;
+  }
+
+  // fields() plus the raw histograms, as one JSON object.
+  std::string json() const {
+    std::string result = toJson(fields());
+    result.pop_back();
+    result += ",\"histograms\":{";
+    for (size_t p = 0; p < PHASES; p++) {
+      result += std::string(p ? "," : "") + "\"" + phaseName(SearchPhase(p)) + "\":[";
+      const std::vector<uint64_t> counts = histogram(SearchPhase(p));
+      for (size_t i = 0; i < BUCKETS; i++) {
+        result += (i ? "," : "") + std::to_string(counts[i]);
+      }
+      result += "]";
+    }
+    return result + "}}";
+  }
+
+private:
+  static constexpr size_t COUNTERS = 14;
+  std::atomic<bool> on{true};
+  std::array<std::atomic<uint64_t>, COUNTERS> totals{};
+  std::array<std::atomic<uint64_t>, PHASES> phaseNs{};
+  std::array<std::array<std::atomic<uint64_t>, BUCKETS>, PHASES> histograms{};
+
+  static double percentileUs(const std::vector<uint64_t>& counts, uint64_t count, double p) {
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+      seen += counts[i];
+      if (count && seen >= p * count) {
+        return (uint64_t(1) << (i + 1)) / 1e3;
+      }
+    }
+    return 0;
+  }
+};
+
+// Times the consecutive phases of one search into stats. Does nothing when
+// stats is null.
+class PhaseTimer {
+public:
+  explicit PhaseTimer(SearchStats* stats) : stats(stats) {
+    if (stats) {
+      last = std::chrono::steady_clock::now();
+    }
+  }
+
+  void lap(SearchPhase phase) {
+    if (!stats) {
+      return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    stats->time(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+    last = now;
+  }
+
+private:
+  SearchStats* stats;
+  std::chrono::steady_clock::time_point last;
+};
+
+// When a scan with a time budget has to give up. Without a budget it never
+// does.
+class ScanDeadline {
+public:
+  explicit ScanDeadline(uint32_t budgetMs) : limited(budgetMs > 0) {
+    if (limited) {
+      end = std::chrono::steady_clock::now() + std::chrono::milliseconds(budgetMs);
+    }
+  }
+
+  bool passed() const {
+    return limited && std::chrono::steady_clock::now() >= end;
+  }
+
+private:
+  bool limited;
+  std::chrono::steady_clock::time_point end;
+};
+
+// Open-addressing table of row ids hashed by a string key of the row, for
+// exact lookups. Rows with equal keys each get a slot, and find() meets them
+// in row order. Keys are hashed with hashBytes so the slots can be saved in
+// snapshots.
+class RowHashTable {
+public:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  std::vector<uint32_t> slots;
+  uint32_t rows = 0;
+
+  template <class KeyOf>
+  void build(uint32_t count, KeyOf keyOf) {
+    size_t capacity = 16;
+    while (capacity < 2 * size_t(count)) {
+      capacity *= 2;
+    }
+    slots.assign(capacity, EMPTY);
+    rows = 0;
+    for (uint32_t id = 0; id < count; id++) {
+      place(id, keyOf(id));
+    }
+  }
+
+  // Adds row id, the row after every row already in the table.
+  template <class KeyOf>
+  void insert(uint32_t id, KeyOf keyOf) {
+    if (2 * (size_t(rows) + 1) > slots.size()) {
+      build(id + 1, keyOf);
+    } else {
+      place(id, keyOf(id));
+    }
+  }
+
+  // The first row whose key is key and that accept() takes, or EMPTY.
+  template <class KeyOf, class Accept>
+  uint32_t find(std::string_view key, KeyOf keyOf, Accept accept) const {
+    if (slots.empty()) {
+      return EMPTY;
+    }
+    const size_t mask = slots.size() - 1;
+    for (size_t i = hashBytes(key.data(), key.size()) & mask; slots[i] != EMPTY; i = (i + 1) & mask) {
+      if (keyOf(slots[i]) == key && accept(slots[i])) {
+        return slots[i];
+      }
+    }
+    return EMPTY;
+  }
+
+  size_t bytes() const {
+    return slots.capacity() * sizeof(uint32_t);
+  }
+
+private:
+  void place(uint32_t id, std::string_view key) {
+    const size_t mask = slots.size() - 1;
+    size_t i = hashBytes(key.data(), key.size()) & mask;
+    while (slots[i] != EMPTY) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = id;
+    rows++;
+  }
+};
+
+// The best (priority, freq) of the rows from some row on, the last two keys
+// of the rank order.
+struct RankBound {
+  int32_t priority;
+  int32_t freq;
+};
+
+// Seconds since the Unix epoch, the clock TagUsage decays by.
+static inline int64_t unixSeconds() {
+  return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// How often the user accepted each tag as a completion, decayed so that a use
+// weighs half as much after HALF_LIFE_DAYS. Keyed by hashBytes() of the
+// canonical word, which stays the same across loads and versions where row
+// ids do not. Saved as a small binary file of (tag, count, updated) entries.
+class TagUsage {
+public:
+  static constexpr double HALF_LIFE_DAYS = 30;
+  // Decayed counts below which an entry is not saved.
+  static constexpr double MIN_COUNT = 1.0 / 16;
+
+  bool empty() const {
+    return entries.empty();
+  }
+
+  size_t size() const {
+    return entries.size();
+  }
+
+  // Adds one use of tag at now and returns its boost.
+  int32_t record(uint64_t tag, int64_t now) {
+    Entry& entry = entries[tag];
+    entry.count = decayed(entry, now) + 1;
+    entry.updated = now;
+    return level(entry.count);
+  }
+
+  // The priority rank() adds for tag at now: 0 for a tag not used lately,
+  // then one more each time the decayed count doubles, so that tags used
+  // about as often are still told apart by freq.
+  int32_t boost(uint64_t tag, int64_t now) const {
+    const auto it = entries.find(tag);
+    return it == entries.end() ? 0 : level(decayed(it->second, now));
+  }
+
+  // Written next to path and renamed like snapshots.
+  bool save(const std::string& path, int64_t now) const {
+    std::vector<Saved> saved;
+    for (const auto& [tag, entry] : entries) {
+      const double count = decayed(entry, now);
+      if (count >= MIN_COUNT) {
+        saved.push_back({tag, count, now});
+      }
+    }
+    Header header{};
+    std::memcpy(header.magic, "SDSUSAGE", sizeof(header.magic));
+    header.version = Header::VERSION;
+    header.entries = saved.size();
+    const std::string tmpPath = path + ".tmp";
+    {
+      std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char*>(saved.data()), saved.size() * sizeof(Saved));
+      if (!out) {
+        return false;
+      }
+    }
+#ifdef _WIN32
+    // See Database::saveSnapshot().
+    std::remove(path.c_str());
+#endif
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+  }
+
+  // Replaces the counts with those saved at path. Returns false, keeping
+  // the counts, when the file is missing or not a usage file.
+  bool load(const std::string& path) {
+    const MappedFile file(path);
+    Header header;
+    if (file.size() < sizeof(header)) {
+      return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    const size_t payload = file.size() - sizeof(header);
+    if (std::memcmp(header.magic, "SDSUSAGE", sizeof(header.magic)) != 0 || header.version != Header::VERSION ||
+        payload % sizeof(Saved) != 0 || header.entries != payload / sizeof(Saved)) {
+      return false;
+    }
+    std::vector<Saved> saved(header.entries);
+    std::memcpy(saved.data(), file.data() + sizeof(header), saved.size() * sizeof(Saved));
+    entries.clear();
+    for (const Saved& item : saved) {
+      entries[item.tag] = {item.count, item.updated};
+    }
+    return true;
+  }
+
+private:
+  struct Entry {
+    double count = 0;
+    int64_t updated = 0;
+  };
+
+  struct Header {
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t entries;
+  };
+
+  struct Saved {
+    uint64_t tag;
+    double count;
+    int64_t updated;
+  };
+
+  std::unordered_map<uint64_t, Entry> entries;
+
+  static double decayed(const Entry& entry, int64_t now) {
+    const double days = std::max<int64_t>(0, now - entry.updated) / 86400.0;
+    return entry.count * std::exp2(-days / HALF_LIFE_DAYS);
+  }
+
+  // Rounded first, or a count would fall a level a second after it was
+  // recorded; a single use thus boosts for about HALF_LIFE_DAYS.
+  static int32_t level(double count) {
+    const int64_t uses = std::llround(count);
+    return uses < 1 ? 0 : 1 + int32_t(std::log2(double(uses)));
+  }
+};
+
+// The TagUsage boost of each row of one store, and per block of rows the
+// highest boost from that block on, so that canStop() can still bound the
+// rows left. Atomic because an accepted completion raises a boost while
+// searches read the store.
+class RowBoosts {
+public:
+  RowBoosts(size_t rows, size_t blockRows) : blockRows(blockRows), boosts(rows), bounds((rows + blockRows - 1) / blockRows) {}
+
+  // 0 for rows added after the boosts were set up.
+  int32_t row(uint32_t id) const {
+    return id < boosts.size() ? boosts[id].load(std::memory_order_relaxed) : 0;
+  }
+
+  int32_t from(uint32_t block) const {
+    return block < bounds.size() ? bounds[block].load(std::memory_order_relaxed) : 0;
+  }
+
+  // Raises the bounds of the blocks up to id's as raiseBound() does. A
+  // lowered boost leaves them loose.
+  void set(uint32_t id, int32_t boost) {
+    if (id >= boosts.size()) {
+      return;
+    }
+    boosts[id].store(boost, std::memory_order_relaxed);
+    for (size_t block = id / blockRows + 1; block-- > 0;) {
+      if (bounds[block].load(std::memory_order_relaxed) >= boost) {
+        break;
+      }
+      bounds[block].store(boost, std::memory_order_relaxed);
+    }
+  }
+
+  size_t bytes() const {
+    return (boosts.capacity() + bounds.capacity()) * sizeof(std::atomic<int32_t>);
+  }
+
+private:
+  size_t blockRows;
+  std::vector<std::atomic<int32_t>> boosts;
+  std::vector<std::atomic<int32_t>> bounds;
+};
+
+// A set of rows that is emptied in O(1): a row is in the set while its stamp
+// equals the current epoch, and clear() moves to the next epoch.
+class RowMarks {
+public:
+  void clear(size_t rows) {
+    if (stamps.size() < rows) {
+      stamps.resize(rows, 0);
+    }
+    if (++epoch == 0) {
+      std::fill(stamps.begin(), stamps.end(), 0);
+      epoch = 1;
+    }
+  }
+
+  void mark(uint32_t id) {
+    stamps[id] = epoch;
+  }
+
+  bool marked(uint32_t id) const {
+    return stamps[id] == epoch;
+  }
+
+private:
+  std::vector<uint32_t> stamps;
+  uint32_t epoch = 0;
+};
+
+// One keyed change to a loaded database, with the fields of a CSV row. The
+// word is the key: an upsert of a loaded word updates that row in place.
+struct TagUpdate {
+  bool remove = false;
+  std::string word;
+  int32_t category = 0;
+  int64_t freq = 0;
+  std::string redirect = "null";
+};
+
+// The rows of one loaded database and the indexes over them. A published
+// store is not modified while a search can see it: a reload builds a new one
+// and swaps it in, updates copy it first unless nobody else holds it, and
+// searches keep the store they started on alive through a shared_ptr.
+class TagStore {
+public:
+  static constexpr uint32_t NO_REDIRECT = 0;
+  static constexpr uint32_t NO_ROW = UINT32_MAX;
+
+  // Bumped on every load so that sessions can drop state from older stores.
+  uint64_t generation = 0;
+  LoadStats loadStats;
+  StringColumn normalized;
+  StringArena strings;
+  std::vector<WordRecord> records;
+  std::vector<StringRef> redirects;
+  // The UTF-8 normalized, shortened and word of row i at 3i, 3i + 1 and
+  // 3i + 2, and of each redirect slot, for handing results out as is.
+  Utf8Column utf8;
+  Utf8Column redirectUtf8;
+  SearchIndex index;
+  InitialsIndex initials;
+  // Per row, the first canonical row with the row's word, or for an alias the
+  // first canonical row with its redirect. NO_ROW when that tag is not
+  // loaded.
+  std::vector<uint32_t> canonical;
+  // Per block of BOUND_ROWS rows, the best RankBound of the rows from the
+  // block on.
+  std::vector<RankBound> bounds;
+  // Rows by word and by normalized form, for lookup().
+  RowHashTable wordRows;
+  RowHashTable normalizedRows;
+  // Per row, 1 once remove() dropped it. Empty while nothing was removed.
+  std::vector<uint8_t> removed;
+  uint32_t removedRows = 0;
+  // Usage boosts of the rows, added to their priority when ranking. Null
+  // for a store no Database published.
+  std::shared_ptr<RowBoosts> boosts;
+
+  // Appends the loader chunks in order so rows keep their load order, and
+  // empties chunks, freeing each one as soon as it is appended. A load
+  // merges each batch into the same columns with the same redirectIds, the
+  // slot of each redirect target so far.
+  void merge(std::vector<LoadChunk>& chunks, std::unordered_map<std::string_view, uint32_t>& redirectIds) {
+    size_t rows = size(), normalizedLength = normalized.data.size(), utf8Length = utf8.data.size(), stringsLength = strings.data.size();
+    for (const auto& chunk : chunks) {
+      rows += chunk.records.size();
+      normalizedLength += chunk.normalized.data.size();
+      utf8Length += chunk.utf8.data.size();
+      stringsLength += chunk.strings.data.size();
+    }
+    normalized.data.reserve(normalizedLength);
+    normalized.offsets.reserve(rows + 1);
+    utf8.data.reserve(utf8Length);
+    utf8.offsets.reserve(3 * rows + 1);
+    strings.data.reserve(stringsLength);
+    records.reserve(rows);
+    // Redirect targets repeat a lot (every alias of 1girl points at it), so
+    // each distinct target is stored once. Slot 0 is "null".
+    if (redirects.empty()) {
+      redirects.push_back(strings.add(u"null"));
+      redirectUtf8.push_back("null");
+      redirectIds["null"] = NO_REDIRECT;
+    }
+    for (auto& chunk : chunks) {
+      normalized.append(chunk.normalized);
+      utf8.append(chunk.utf8);
+      const uint32_t stringsBase = strings.data.size();
+      strings.data.insert(strings.data.end(), chunk.strings.data.begin(), chunk.strings.data.end());
+      for (size_t i = 0; i < chunk.records.size(); i++) {
+        WordRecord record = chunk.records[i];
+        record.shortened.offset += stringsBase;
+        record.word.offset += stringsBase;
+        auto [it, inserted] = redirectIds.try_emplace(chunk.redirects[i], redirects.size());
+        if (inserted) {
+          redirects.push_back(strings.add(utf8ToUtf16(chunk.redirects[i])));
+          redirectUtf8.push_back(chunk.redirects[i]);
+        }
+        record.redirect = it->second;
+        records.push_back(record);
+      }
+      chunk = LoadChunk();
+    }
+    chunks.clear();
+    strings.shrink_to_fit();
+    redirectUtf8.shrink_to_fit();
+  }
+
+  void write(SnapshotWriter& writer) const {
+    writer.write(normalized.data);
+    writer.write(normalized.offsets);
+    writer.write(strings.data);
+    writer.write(records);
+    writer.write(redirects);
+    writer.write(utf8.data);
+    writer.write(utf8.offsets);
+    writer.write(redirectUtf8.data);
+    writer.write(redirectUtf8.offsets);
+    writer.write(index.signatures);
+    writer.write(index.rareChars);
+    writer.write(index.postingOffsets);
+    writer.write(index.postingIds);
+    writer.write(index.presentChars);
+    writer.write(initials.byPrefix);
+    writer.write(initials.bySuffix);
+    writer.write(canonical);
+    writer.write(bounds);
+    writer.write(wordRows.slots);
+    writer.write(normalizedRows.slots);
+  }
+
+  bool read(SnapshotReader& reader, uint32_t rows) {
+    const bool valid = reader.read(normalized.data) && reader.read(normalized.offsets) &&
+           reader.read(strings.data) && reader.read(records) && reader.read(redirects) &&
+           reader.read(utf8.data) && reader.read(utf8.offsets) &&
+           reader.read(redirectUtf8.data) && reader.read(redirectUtf8.offsets) &&
+           reader.read(index.signatures) && reader.read(index.rareChars) &&
+           reader.read(index.postingOffsets) && reader.read(index.postingIds) &&
+           reader.read(index.presentChars) && reader.read(initials.byPrefix) && reader.read(initials.bySuffix) &&
+           reader.read(canonical) && reader.read(bounds) &&
+           reader.read(wordRows.slots) && reader.read(normalizedRows.slots) && reader.done() &&
+           records.size() == rows && normalized.size() == rows && index.signatures.size() == rows &&
+           utf8.size() == 3 * rows && redirectUtf8.size() == redirects.size() &&
+           initials.byPrefix.size() == rows && initials.bySuffix.size() == rows &&
+           canonical.size() == rows && bounds.size() == (rows + BOUND_ROWS - 1) / BOUND_ROWS &&
+           wordRows.slots.size() >= 2 * size_t(rows) && normalizedRows.slots.size() >= 2 * size_t(rows);
+    index.indexedRows = rows;
+    wordRows.rows = normalizedRows.rows = rows;
+    return valid;
+  }
+
+  // Fills canonical and bounds once the rows are in place.
+  void buildRanking() {
+    std::unordered_map<std::u16string_view, uint32_t> rows;
+    for (uint32_t id = 0; id < size(); id++) {
+      if (records[id].redirect == NO_REDIRECT) {
+        rows.try_emplace(strings.get(records[id].word), id);
+      }
+    }
+    canonical.resize(size());
+    for (uint32_t id = 0; id < size(); id++) {
+      const WordRecord& record = records[id];
+      const auto it = rows.find(strings.get(record.redirect == NO_REDIRECT ? record.word : redirects[record.redirect]));
+      canonical[id] = it == rows.end() ? NO_ROW : it->second;
+    }
+    bounds.resize((size() + BOUND_ROWS - 1) / BOUND_ROWS);
+    RankBound best{INT32_MIN, INT32_MIN};
+    for (uint32_t id = size(); id-- > 0;) {
+      const RankBound row{records[id].priority, (int32_t)records[id].freq};
+      if (std::tie(row.priority, row.freq) > std::tie(best.priority, best.freq)) {
+        best = row;
+      }
+      if (id % BOUND_ROWS == 0) {
+        bounds[id / BOUND_ROWS] = best;
+      }
+    }
+  }
+
+  // Adds update.word as a new row, or updates the row already keyed by it.
+  // New rows are appended past the posting lists and scanned until the next
+  // compact(). Returns false when a field is longer than MAX_WORD_LEN, like
+  // the loader skips such lines. Amortized O(1) apart from relinking the
+  // aliases of update.word, if it is a redirect target; the first edit of a
+  // store builds the keys in O(n).
+  bool upsert(const TagUpdate& update) {
+    if (update.word.size() > MAX_WORD_LEN || update.redirect.size() > MAX_WORD_LEN) {
+      return false;
+    }
+    buildKeys();
+    const uint32_t redirect = redirectSlot(update.redirect);
+    uint32_t id = findWord(update.word);
+    if (id != NO_ROW) {
+      WordRecord& record = records[id];
+      record.category = update.category;
+      record.freq = update.freq;
+      if (record.redirect != redirect) {
+        unlinkAlias(id);
+        record.redirect = redirect;
+        linkAlias(id);
+      }
+    } else {
+      id = size();
+      const std::string normalizedWord = normalize(update.word);
+      const std::string shortenedWord = shorten(update.word);
+      const std::u16string normalized16 = utf8ToUtf16(normalizedWord);
+      normalized.push_back(normalized16);
+      utf8.push_back(normalizedWord);
+      utf8.push_back(shortenedWord);
+      utf8.push_back(update.word);
+      const StringRef shortenedRef = strings.add(utf8ToUtf16(shortenedWord));
+      const StringRef wordRef = strings.add(utf8ToUtf16(update.word));
+      records.push_back({shortenedRef, wordRef, redirect, update.category, update.freq, 0});
+      index.append(normalized16);
+      canonical.push_back(NO_ROW);
+      if (!removed.empty()) {
+        removed.push_back(0);
+      }
+      if (id % BOUND_ROWS == 0) {
+        bounds.push_back({INT32_MIN, INT32_MIN});
+      }
+      wordRows.insert(id, WordKey{this});
+      normalizedRows.insert(id, NormalizedKey{this});
+      linkAlias(id);
+    }
+    raiseBound(id);
+    canonical[id] = redirect == NO_REDIRECT ? id : canonicalRow(update.redirect);
+    relinkAliases(update.word);
+    return true;
+  }
+
+  // Drops the row keyed by word. The row stays in the columns, skipped by
+  // searches, until the next compact(). Returns false when word is not
+  // loaded. Costs as much as upsert().
+  bool remove(const std::string& word) {
+    const uint32_t id = findWord(word);
+    if (id == NO_ROW) {
+      return false;
+    }
+    buildKeys();
+    if (removed.empty()) {
+      removed.resize(size());
+    }
+    removed[id] = 1;
+    removedRows++;
+    relinkAliases(word);
+    return true;
+  }
+
+  bool isLive(uint32_t id) const {
+    return removed.empty() || !removed[id];
+  }
+
+  // Whether every row is live and covered by the posting lists.
+  bool isCompact() const {
+    return removedRows == 0 && index.indexedRows == size();
+  }
+
+  // Whether enough rows were removed or appended since the last build that
+  // compact() pays for itself, or could be after edits more updates.
+  bool needsCompaction(size_t edits = 0) const {
+    const size_t stale = removedRows + (size() - index.indexedRows) + edits;
+    return stale >= COMPACT_MIN_ROWS && stale * 4 >= size();
+  }
+
+  // Rewrites the columns without the removed rows and rebuilds the index
+  // over all of them. Live rows keep their order and redirect slots stay.
+  void compact() {
+    TagStore live;
+    for (uint32_t slot = 0; slot < redirects.size(); slot++) {
+      live.redirects.push_back(live.strings.add(strings.get(redirects[slot])));
+    }
+    live.redirectUtf8 = std::move(redirectUtf8);
+    for (uint32_t id = 0; id < size(); id++) {
+      if (!isLive(id)) {
+        continue;
+      }
+      live.normalized.push_back(normalized[id]);
+      for (uint32_t i = 3 * id; i < 3 * id + 3; i++) {
+        live.utf8.push_back(utf8[i]);
+      }
+      WordRecord record = records[id];
+      record.shortened = live.strings.add(strings.get(record.shortened));
+      record.word = live.strings.add(strings.get(record.word));
+      live.records.push_back(record);
+    }
+    normalized = std::move(live.normalized);
+    utf8 = std::move(live.utf8);
+    strings = std::move(live.strings);
+    records = std::move(live.records);
+    redirects = std::move(live.redirects);
+    redirectUtf8 = std::move(live.redirectUtf8);
+    removed.clear();
+    removedRows = 0;
+    keyed = false;
+    redirectSlots.clear();
+    aliasHeads.clear();
+    aliasLinks.clear();
+    index.build(normalized);
+    buildInitials();
+    buildRanking();
+    buildLookup();
+  }
+
+  // The canonical row of id: id itself or the first row with the same word
+  // for a tag, the row its redirect names for an alias, and NO_ROW when that
+  // tag is not loaded.
+  uint32_t canonicalOf(uint32_t id) const {
+    return canonical[id];
+  }
+
+  // The tag id stands for: its own word, or its redirect target for an
+  // alias, loaded or not.
+  std::string_view canonicalWord(uint32_t id) const {
+    const WordText text = getText(id);
+    return records[id].redirect == NO_REDIRECT ? text.word : text.redirect;
+  }
+
+  // The redirect targets of live aliases that are not loaded, each once.
+  std::vector<std::string_view> danglingRedirects() const {
+    std::vector<bool> listed(redirects.size());
+    std::vector<std::string_view> targets;
+    for (uint32_t id = 0; id < size(); id++) {
+      const uint32_t slot = records[id].redirect;
+      if (slot != NO_REDIRECT && canonical[id] == NO_ROW && isLive(id) && !listed[slot]) {
+        listed[slot] = true;
+        targets.push_back(redirectUtf8[slot]);
+      }
+    }
+    return targets;
+  }
+
+  // Fills initials once the rows are in place.
+  void buildInitials() {
+    initials.build(size(), ShortenedKey{this});
+  }
+
+  // Fills wordRows and normalizedRows once the rows are in place.
+  void buildLookup() {
+    wordRows.build(size(), WordKey{this});
+    normalizedRows.build(size(), NormalizedKey{this});
+  }
+
+  // The row of tag, matched on the word as written and then on its
+  // normalized form, or NO_ROW when neither is loaded. Takes the first live
+  // row when several share the key.
+  uint32_t lookup(const std::string& tag) const {
+    const auto live = [&](uint32_t id) {
+      return isLive(id);
+    };
+    const uint32_t id = wordRows.find(tag, WordKey{this}, live);
+    return id != RowHashTable::EMPTY ? id : normalizedRows.find(normalize(tag), NormalizedKey{this}, live);
+  }
+
+  std::vector<uint32_t> lookupBatch(const std::vector<std::string>& tags) const {
+    std::vector<uint32_t> rows;
+    rows.reserve(tags.size());
+    for (const auto& tag : tags) {
+      rows.push_back(lookup(tag));
+    }
+    return rows;
+  }
+
+  uint32_t size() const {
+    return records.size();
+  }
+
+  // The priority id ranks with: its own plus its usage boost.
+  int32_t priorityOf(uint32_t id) const {
+    return records[id].priority + (boosts ? boosts->row(id) : 0);
+  }
+
+  // The row an accepted completion of tag boosts, its canonical row, or
+  // NO_ROW when that is not loaded.
+  uint32_t usageRow(const std::string& tag) const {
+    const uint32_t id = lookup(tag);
+    return id == NO_ROW ? NO_ROW : canonicalOf(id);
+  }
+
+  // The TagUsage key of a canonical row.
+  uint64_t usageKey(uint32_t id) const {
+    const std::string_view word = utf8[3 * id + 2];
+    return hashBytes(word.data(), word.size());
+  }
+
+  // Gives the store its own boosts, set from usage at now. Only for a store
+  // that no search holds.
+  void attachUsage(const TagUsage& usage, int64_t now) {
+    boosts = std::make_shared<RowBoosts>(size(), BOUND_ROWS);
+    if (!usage.empty()) {
+      applyUsage(usage, now);
+    }
+  }
+
+  // Sets the boost of every canonical row from usage at now, in place.
+  void applyUsage(const TagUsage& usage, int64_t now) const {
+    if (!boosts) {
+      return;
+    }
+    for (uint32_t id = 0; id < size(); id++) {
+      if (canonical[id] != id || !isLive(id)) {
+        continue;
+      }
+      const int32_t boost = usage.empty() ? 0 : usage.boost(usageKey(id), now);
+      if (boost != boosts->row(id)) {
+        boosts->set(id, boost);
+      }
+    }
+  }
+
+  void boostRow(uint32_t id, int32_t boost) const {
+    if (boosts) {
+      boosts->set(id, boost);
+    }
+  }
+
+  Word getWord(uint32_t id) const {
+    const WordRecord& record = records[id];
+    return Word(normalized[id], strings.get(record.shortened), strings.get(record.word), strings.get(redirects[record.redirect]), record.freq, record.category, priorityOf(id), id);
+  }
+
+  std::vector<Word> getWords(const std::vector<uint32_t>& ids) const {
+    std::vector<Word> result;
+    result.reserve(ids.size());
+    for (uint32_t id : ids) {
+      result.push_back(getWord(id));
+    }
+    return result;
+  }
+
+  static std::vector<uint32_t> rowsOf(const std::vector<Word>& result) {
+    std::vector<uint32_t> ids(result.size());
+    for (size_t i = 0; i < result.size(); i++) {
+      ids[i] = result[i].id;
+    }
+    return ids;
+  }
+
+  WordText getText(uint32_t id) const {
+    return WordText{utf8[3 * id], utf8[3 * id + 1], utf8[3 * id + 2], redirectUtf8[records[id].redirect]};
+  }
+
+  // Packs result into out, which must be packedSize() bytes long.
+  size_t packedSize(const std::vector<Word>& result) const {
+    return PackedLayout(result.size(), packedStringBytes(result)).size;
+  }
+
+  PackedLayout pack(const std::vector<Word>& result, char* out) const {
+    const PackedLayout layout(result.size(), packedStringBytes(result));
+    std::memcpy(out, &layout.count, sizeof(uint32_t));
+    std::memcpy(out + sizeof(uint32_t), &layout.stringBytes, sizeof(uint32_t));
+    uint32_t offset = 0;
+    std::memcpy(out + layout.offsets, &offset, sizeof(uint32_t));
+    for (size_t i = 0; i < result.size(); i++) {
+      const double freq = result[i].freq;
+      const int32_t category = result[i].category, priority = result[i].priority;
+      std::memcpy(out + layout.freq + i * sizeof(double), &freq, sizeof(double));
+      std::memcpy(out + layout.category + i * sizeof(int32_t), &category, sizeof(int32_t));
+      std::memcpy(out + layout.priority + i * sizeof(int32_t), &priority, sizeof(int32_t));
+      const WordText text = getText(result[i].id);
+      const std::string_view fields[] = {text.normalized, text.shortened, text.word, text.redirect};
+      for (size_t j = 0; j < 4; j++) {
+        std::memcpy(out + layout.strings + offset, fields[j].data(), fields[j].size());
+        offset += fields[j].size();
+        std::memcpy(out + layout.offsets + (4 * i + j + 1) * sizeof(uint32_t), &offset, sizeof(uint32_t));
+      }
+    }
+    return layout;
+  }
+
+  MemoryUsage memoryUsage() const {
+    MemoryUsage usage;
+    usage.rows = size();
+    usage.normalizedBytes = normalized.bytes();
+    usage.stringBytes = strings.bytes() + utf8.bytes() + redirectUtf8.bytes();
+    usage.recordBytes = records.capacity() * sizeof(WordRecord) + redirects.capacity() * sizeof(StringRef);
+    usage.indexBytes = index.bytes() + initials.bytes() + canonical.capacity() * sizeof(uint32_t) + bounds.capacity() * sizeof(RankBound) +
+                       wordRows.bytes() + normalizedRows.bytes() + removed.capacity() + (boosts ? boosts->bytes() : 0);
+    return usage;
+  }
+
+  inline static bool isSubsequence(std::u16string_view small, std::u16string_view large) {
+    size_t i = 0, j = 0;
+    while (i < small.size() && j < large.size()) {
+      if (small[i] == large[j]) {
+        i++;
+      }
+      j++;
+    }
+    return i == small.size();
+  }
+
+  // Returns nothing when cancelled. With a pool the scan and the ranking are
+  // split into shards; the result is the same as without.
+  std::vector<Word> search(const std::string& word, const SearchCancel* cancel = nullptr, ThreadPool* pool = nullptr, const SearchOptions& options = SearchOptions()) const {
+    const std::u16string query = normalizeUtf16(word);
+    std::vector<uint32_t> ids;
+    collect(query, 0, ids, cancel, pool, options);
+    if (cancel && cancel->cancelled()) {
+      return {};
+    }
+    std::vector<Word> result = rank(query, ids, pool, options);
+    appendFuzzy(query, result, cancel, options);
+    return result;
+  }
+
+  // Runs every query of words and returns the best resultLimit rows of
+  // each, the same rows search() ranks first. Queries with a posting list
+  // are collected on their own; the rest share one pass over the rows that
+  // tests each row against all of them while it is in cache.
+  std::vector<std::vector<Word>> searchMany(const std::vector<std::string>& words, const SearchOptions& options = SearchOptions()) const {
+    std::vector<std::vector<Word>> results(words.size());
+    if (options.resultLimit == 0) {
+      return results;
+    }
+    // Repeated queries are run once.
+    std::vector<std::u16string> queries;
+    std::vector<size_t> queryOf(words.size());
+    std::unordered_map<std::u16string, size_t> queryIds;
+    for (size_t i = 0; i < words.size(); i++) {
+      auto [it, inserted] = queryIds.try_emplace(normalizeUtf16(words[i]), queries.size());
+      if (inserted) {
+        queries.push_back(it->first);
+      }
+      queryOf[i] = it->second;
+    }
+    std::vector<std::vector<uint32_t>> ids(queries.size());
+    std::vector<size_t> shared;
+    for (size_t q = 0; q < queries.size(); q++) {
+      if (index.candidates(queries[q])) {
+        collect(queries[q], 0, ids[q], nullptr, nullptr, options);
+      } else {
+        shared.push_back(q);
+      }
+    }
+    collectShared(queries, shared, ids, options);
+    std::vector<std::vector<Word>> ranked(queries.size());
+    for (size_t q = 0; q < queries.size(); q++) {
+      ranked[q] = rank(queries[q], ids[q], nullptr, options);
+      appendFuzzy(queries[q], ranked[q], nullptr, options);
+    }
+    for (size_t i = 0; i < words.size(); i++) {
+      results[i] = ranked[queryOf[i]];
+    }
+    return results;
+  }
+
+  // Appends the rows from `begin` on that contain query as a subsequence
+  // until ids holds scanBudget rows or timeBudgetMs ran out: first those the
+  // initials index finds, then the rest in row order. Returns the row the
+  // scan stopped at so that it can be resumed later. A serial scan also
+  // stops once no row after it can make the top resultLimit of rank(); ids
+  // then still holds every match before the returned row. When the initials
+  // index alone settles the top rows there is no scan and begin is returned.
+  uint32_t collect(std::u16string_view query, uint32_t begin, std::vector<uint32_t>& ids, const SearchCancel* cancel = nullptr, ThreadPool* pool = nullptr, const SearchOptions& options = SearchOptions(), SearchCounters* counters = nullptr) const {
+    if (ids.size() >= options.scanBudget) {
+      return begin;
+    }
+    // Rows from begin on that are already collected, sorted, for the scan to
+    // pass over.
+    std::vector<uint32_t> ahead;
+    if (collectInitials(query, begin, ids, options, ahead, counters) || ids.size() >= options.scanBudget) {
+      return begin;
+    }
+    const size_t budget = options.scanBudget, limit = options.resultLimit;
+    const size_t quota = budget - ids.size();
+    const ScanDeadline deadline(options.timeBudgetMs);
+    const uint64_t signature = calcSignature(query);
+    // The scan walks the shortest posting list of the query's rare characters
+    // if there is one and all rows otherwise, from the first entry at or after
+    // begin. Rows appended since the index was built follow the list.
+    const auto candidates = index.candidates(query);
+    const uint32_t* list = candidates ? std::lower_bound(candidates->begin(), candidates->end(), begin) : nullptr;
+    const uint32_t listed = candidates ? candidates->end() - list : 0;
+    const uint32_t tail = std::min(candidates ? std::max(begin, index.indexedRows) : begin, size());
+    const uint32_t count = listed + (size() - tail);
+    const auto rowAt = [&](uint32_t i) {
+      return i < listed ? list[i] : tail + (i - listed);
+    };
+    const auto matches = [&](uint32_t id) {
+      return matchesRow(query, signature, id) && !std::binary_search(ahead.begin(), ahead.end(), id);
+    };
+
+    const uint32_t shards = pool && pool->size() > 1 ? std::max<uint32_t>(1, (count + SHARD_ROWS - 1) / SHARD_ROWS) : 1;
+    if (!pool || shards == 1) {
+      // Matches that score 0 against both forms are the only ones that can
+      // tie or beat the rows still to come; see canStop().
+      std::vector<uint32_t> leaders;
+      for (uint32_t id : ids) {
+        if (isGapFree(query, id)) {
+          leaders.push_back(id);
+        }
+      }
+      const size_t before = ids.size();
+      // Rows scanned, and where the scan stopped, for counters.
+      const auto stop = [&](uint32_t scanned, uint64_t SearchCounters::*skipped, uint32_t row) {
+        if (counters) {
+          counters->rowsScanned += scanned;
+          counters->subsequenceHits += ids.size() - before;
+          if (skipped) {
+            counters->*skipped += count - scanned;
+          }
+        }
+        return row;
+      };
+      uint32_t block = UINT32_MAX;
+      for (uint32_t i = 0; i < count; i++) {
+        const uint32_t id = rowAt(i);
+        if (id / BOUND_ROWS != block) {
+          block = id / BOUND_ROWS;
+          if (leaders.size() >= limit && canStop(query, leaders, id, limit)) {
+            return stop(i, &SearchCounters::boundSkippedRows, id);
+          }
+        }
+        if (matches(id)) {
+          ids.push_back(id);
+          if (isGapFree(query, id)) {
+            leaders.push_back(id);
+          }
+          if (ids.size() >= budget) {
+            return stop(i + 1, &SearchCounters::cutoffRows, id + 1);
+          }
+        }
+        if ((i + 1) % CANCEL_CHECK_INTERVAL == 0) {
+          if (cancel && cancel->cancelled()) {
+            return stop(i + 1, nullptr, id + 1);
+          }
+          if (deadline.passed()) {
+            if (counters) {
+              counters->timeouts++;
+            }
+            return stop(i + 1, nullptr, id + 1);
+          }
+        }
+      }
+      return stop(count, nullptr, size());
+    }
+
+    // Shards are claimed in order. Once the finished shards in front have
+    // filled the quota, the shards still running behind them give up. A
+    // shard that runs out of time stops where it is, and the matches are
+    // only kept up to there.
+    std::vector<std::vector<uint32_t>> found(shards);
+    std::vector<uint32_t> scanned(shards);
+    std::atomic<bool> enough{false}, timedOut{false};
+    std::mutex progressMutex;
+    std::vector<bool> finished(shards);
+    uint32_t finishedPrefix = 0;
+    size_t prefixMatches = 0;
+    pool->run(shards, [&](size_t shard) {
+      const uint32_t first = shard * SHARD_ROWS, last = std::min<uint32_t>(count, first + SHARD_ROWS);
+      uint32_t i = first;
+      for (; i < last && !enough.load(std::memory_order_relaxed); i++) {
+        const uint32_t id = rowAt(i);
+        if (matches(id)) {
+          found[shard].push_back(id);
+          if (found[shard].size() >= quota) {
+            i++;
+            break;
+          }
+        }
+        if ((i - first + 1) % CANCEL_CHECK_INTERVAL == 0) {
+          const bool late = deadline.passed();
+          if (late) {
+            timedOut = true;
+          }
+          if (late || (cancel && cancel->cancelled())) {
+            i++;
+            break;
+          }
+        }
+      }
+      scanned[shard] = i - first;
+      std::lock_guard<std::mutex> lock(progressMutex);
+      finished[shard] = true;
+      while (finishedPrefix < shards && finished[finishedPrefix]) {
+        prefixMatches += found[finishedPrefix++].size();
+      }
+      if (prefixMatches >= quota) {
+        enough = true;
+      }
+    });
+    if (counters) {
+      const uint64_t rowsScanned = std::accumulate(scanned.begin(), scanned.end(), uint64_t(0));
+      uint64_t hits = 0;
+      for (const auto& rows : found) {
+        hits += rows.size();
+      }
+      counters->rowsScanned += rowsScanned;
+      counters->subsequenceHits += hits;
+      if (hits >= quota) {
+        counters->cutoffRows += (count - rowsScanned) + (hits - quota);
+      }
+      counters->timeouts += timedOut;
+    }
+    for (uint32_t shard = 0; shard < shards; shard++) {
+      const size_t take = std::min(found[shard].size(), budget - ids.size());
+      ids.insert(ids.end(), found[shard].begin(), found[shard].begin() + take);
+      if (ids.size() >= budget) {
+        return ids.back() + 1;
+      }
+      const uint32_t stopped = shard * SHARD_ROWS + scanned[shard];
+      if (stopped < std::min<uint32_t>(count, (shard + 1) * SHARD_ROWS)) {
+        return rowAt(stopped);
+      }
+    }
+    return size();
+  }
+
+  // Keeps the rows of ids that still match query. Used when query extends
+  // the query ids were collected for.
+  void refine(std::u16string_view query, std::vector<uint32_t>& ids, SearchCounters* counters = nullptr) const {
+    if (counters) {
+      counters->rowsScanned += ids.size();
+    }
+    const uint64_t signature = calcSignature(query);
+    ids.erase(std::remove_if(ids.begin(), ids.end(), [&](uint32_t id) {
+      return (index.signatures[id] & signature) != signature || !isSubsequence(query, normalized[id]);
+    }), ids.end());
+  }
+
+  // Orders the collected rows by how well they match and keeps the best
+  // `limit`. Aliases are dropped when their canonical row was collected too.
+  // Ties go to the earlier row.
+  std::vector<Word> rank(std::u16string_view query, const std::vector<uint32_t>& ids, ThreadPool* pool = nullptr, const SearchOptions& options = SearchOptions(), SearchCounters* counters = nullptr) const {
+    const size_t limit = options.resultLimit;
+    if (limit == 0) {
+      return {};
+    }
+    // Redirects were resolved to rows at load, so the canonical rows that
+    // were collected are marked by id.
+    thread_local RowMarks seen;
+    seen.clear(size());
+    for (uint32_t id : ids) {
+      if (records[id].redirect == NO_REDIRECT) {
+        seen.mark(canonicalOf(id));
+      }
+    }
+    std::vector<uint32_t> candidates;
+    candidates.reserve(ids.size());
+    for (uint32_t id : ids) {
+      const uint32_t target = canonicalOf(id);
+      if (records[id].redirect == NO_REDIRECT || target == NO_ROW || !seen.marked(target)) {
+        candidates.push_back(id);
+      }
+    }
+
+    // Each shard keeps its own best `limit` in a max-heap, and the shard
+    // winners are merged at the end.
+    const size_t shards = pool ? std::max<size_t>(1, std::min(pool->size(), candidates.size() / limit)) : 1;
+    std::vector<std::vector<Ranked>> best(shards);
+    std::vector<uint64_t> longWords(shards);
+    const auto select = [&](size_t shard) {
+      std::priority_queue<Ranked> heap;
+      uint64_t* tooLong = counters ? &longWords[shard] : nullptr;
+      for (size_t i = candidates.size() * shard / shards; i < candidates.size() * (shard + 1) / shards; i++) {
+        const WordRecord& record = records[candidates[i]];
+        const int shortenedGap = options.scoreShortened ? calcGapMatch(query, strings.get(record.shortened), tooLong) : 0;
+        const Ranked ranked{{shortenedGap, calcGapMatch(query, normalized[candidates[i]], tooLong), -priorityOf(candidates[i]), (int)-record.freq}, candidates[i]};
+        if (heap.size() < limit) {
+          heap.push(ranked);
+        } else if (ranked < heap.top()) {
+          heap.pop();
+          heap.push(ranked);
+        }
+      }
+      best[shard].resize(heap.size());
+      for (size_t i = heap.size(); i > 0; i--) {
+        best[shard][i - 1] = heap.top();
+        heap.pop();
+      }
+    };
+    if (pool && shards > 1) {
+      pool->run(shards, select);
+    } else {
+      select(0);
+    }
+    if (counters) {
+      counters->redirectsDeduped += ids.size() - candidates.size();
+      counters->rowsRanked += candidates.size();
+      counters->longWords += std::accumulate(longWords.begin(), longWords.end(), uint64_t(0));
+    }
+    std::vector<Ranked> merged = std::move(best[0]);
+    for (size_t shard = 1; shard < shards; shard++) {
+      const size_t middle = merged.size();
+      merged.insert(merged.end(), best[shard].begin(), best[shard].end());
+      std::inplace_merge(merged.begin(), merged.begin() + middle, merged.end());
+    }
+    std::vector<Word> result;
+    result.reserve(std::min(merged.size(), limit));
+    for (size_t i = 0; i < merged.size() && i < limit; i++) {
+      result.push_back(getWord(merged[i].row));
+    }
+    return result;
+  }
+
+  // When result, the ranked rows of query, holds fewer than fuzzyResults
+  // rows, fills it up to resultLimit with rows whose normalized form holds
+  // query within fuzzyEdits edits, and within one per FUZZY_UNITS_PER_EDIT
+  // code units of query so that short queries are left alone. These rank
+  // after the rows already there, by edit distance and then like rank().
+  // Rows whose length or signature rules out a close match are not
+  // measured. Returns whether the pass ran; it stops early when cancelled or
+  // once fuzzyTimeBudgetMs ran out.
+  bool appendFuzzy(std::u16string_view query, std::vector<Word>& result, const SearchCancel* cancel = nullptr, const SearchOptions& options = SearchOptions(), SearchCounters* counters = nullptr) const {
+    const size_t edits = std::min<size_t>(options.fuzzyEdits, query.size() / FUZZY_UNITS_PER_EDIT);
+    if (result.size() >= options.fuzzyResults || result.size() >= options.resultLimit || edits == 0 || query.size() > MAX_WORD_LEN) {
+      return false;
+    }
+    const EditPattern pattern(query);
+    const uint64_t signature = calcSignature(query);
+    const ScanDeadline deadline(options.fuzzyTimeBudgetMs);
+    // The rows already in result, and the canonical rows among them, whose
+    // aliases are left out as rank() would.
+    thread_local RowMarks listed;
+    listed.clear(size());
+    for (const Word& word : result) {
+      listed.mark(word.id);
+    }
+    const size_t limit = options.resultLimit - result.size();
+    std::priority_queue<Ranked> heap;
+    uint64_t measured = 0, hits = 0;
+    bool timedOut = false;
+    for (uint32_t id = 0; id < size(); id++) {
+      if ((id + 1) % CANCEL_CHECK_INTERVAL == 0) {
+        if (cancel && cancel->cancelled()) {
+          break;
+        }
+        if (deadline.passed()) {
+          timedOut = true;
+          break;
+        }
+      }
+      const std::u16string_view text = normalized[id];
+      if (text.size() + edits < query.size() || std::bitset<64>(signature & ~index.signatures[id]).count() > edits || listed.marked(id) || !isLive(id)) {
+        continue;
+      }
+      const uint32_t target = canonicalOf(id);
+      if (records[id].redirect != NO_REDIRECT && target != NO_ROW && listed.marked(target)) {
+        continue;
+      }
+      measured++;
+      const int distance = pattern.distance(text, edits);
+      if (distance > int(edits)) {
+        continue;
+      }
+      hits++;
+      const Ranked ranked{{distance, 0, -priorityOf(id), (int)-records[id].freq}, id};
+      if (heap.size() < limit) {
+        heap.push(ranked);
+      } else if (ranked < heap.top()) {
+        heap.pop();
+        heap.push(ranked);
+      }
+    }
+    if (counters) {
+      counters->fuzzyRows += measured;
+      counters->fuzzyHits += hits;
+      counters->fuzzyTimeouts += timedOut;
+    }
+    std::vector<uint32_t> found(heap.size());
+    for (size_t i = heap.size(); i > 0; i--) {
+      found[i - 1] = heap.top().row;
+      heap.pop();
+    }
+    for (uint32_t id : found) {
+      if (records[id].redirect == NO_REDIRECT) {
+        listed.mark(id);
+      }
+    }
+    for (uint32_t id : found) {
+      const uint32_t target = canonicalOf(id);
+      if (records[id].redirect == NO_REDIRECT || target == NO_ROW || !listed.marked(target)) {
+        result.push_back(getWord(id));
+      }
+    }
+    return true;
+  }
+
+private:
+  uint32_t packedStringBytes(const std::vector<Word>& result) const {
+    uint32_t bytes = 0;
+    for (const auto& item : result) {
+      const WordText text = getText(item.id);
+      bytes += text.normalized.size() + text.shortened.size() + text.word.size() + text.redirect.size();
+    }
+    return bytes;
+  }
+
+  // Rows per shard of a parallel scan.
+  static constexpr uint32_t SHARD_ROWS = 16384;
+  // Rows between checks for cancellation and the time budget.
+  static constexpr uint32_t CANCEL_CHECK_INTERVAL = 4096;
+  // Rows per entry of bounds.
+  static constexpr uint32_t BOUND_ROWS = 1024;
+  // Rows per initials index hit below which the hits are sorted rather than
+  // found by walking the rows.
+  static constexpr size_t DENSE_INITIALS_RATIO = 16;
+  // Removed plus unindexed rows below which compacting is not worth it.
+  static constexpr size_t COMPACT_MIN_ROWS = 1024;
+  // Query code units per edit the fuzzy pass allows.
+  static constexpr size_t FUZZY_UNITS_PER_EDIT = 4;
+
+  // Redirect slot per target, and the rows redirected through each slot as
+  // a list threaded through aliasLinks, built on the first upsert() or
+  // remove(). Flat, so that copying a store stays cheap.
+  struct AliasLink {
+    uint32_t prev;
+    uint32_t next;
+  };
+  bool keyed = false;
+  std::unordered_map<std::string, uint32_t> redirectSlots;
+  std::vector<uint32_t> aliasHeads;
+  std::vector<AliasLink> aliasLinks;
+
+  void buildKeys() {
+    if (keyed) {
+      return;
+    }
+    keyed = true;
+    for (uint32_t slot = 0; slot < redirectUtf8.size(); slot++) {
+      redirectSlots.emplace(std::string(redirectUtf8[slot]), slot);
+    }
+    for (uint32_t id = 0; id < size(); id++) {
+      linkAlias(id);
+    }
+  }
+
+  // Lists id under its redirect slot.
+  void linkAlias(uint32_t id) {
+    aliasLinks.resize(size(), {NO_ROW, NO_ROW});
+    const uint32_t slot = records[id].redirect;
+    if (slot == NO_REDIRECT) {
+      return;
+    }
+    if (aliasHeads.size() <= slot) {
+      aliasHeads.resize(slot + 1, NO_ROW);
+    }
+    const uint32_t next = aliasHeads[slot];
+    aliasLinks[id] = {NO_ROW, next};
+    if (next != NO_ROW) {
+      aliasLinks[next].prev = id;
+    }
+    aliasHeads[slot] = id;
+  }
+
+  // Takes id off the list of its redirect slot, before the slot changes.
+  void unlinkAlias(uint32_t id) {
+    if (records[id].redirect == NO_REDIRECT) {
+      return;
+    }
+    const AliasLink link = aliasLinks[id];
+    if (link.prev != NO_ROW) {
+      aliasLinks[link.prev].next = link.next;
+    } else {
+      aliasHeads[records[id].redirect] = link.next;
+    }
+    if (link.next != NO_ROW) {
+      aliasLinks[link.next].prev = link.prev;
+    }
+    aliasLinks[id] = {NO_ROW, NO_ROW};
+  }
+
+  uint32_t redirectSlot(const std::string& redirect) {
+    if (redirects.empty()) {
+      redirects.push_back(strings.add(u"null"));
+      redirectUtf8.push_back("null");
+      redirectSlots["null"] = NO_REDIRECT;
+    }
+    auto [it, inserted] = redirectSlots.try_emplace(redirect, redirects.size());
+    if (inserted) {
+      redirects.push_back(strings.add(utf8ToUtf16(redirect)));
+      redirectUtf8.push_back(redirect);
+    }
+    return it->second;
+  }
+
+  // Keys of the lookup tables.
+  struct WordKey {
+    const TagStore* store;
+
+    std::string_view operator()(uint32_t id) const {
+      return store->utf8[3 * id + 2];
+    }
+  };
+
+  struct NormalizedKey {
+    const TagStore* store;
+
+    std::string_view operator()(uint32_t id) const {
+      return store->utf8[3 * id];
+    }
+  };
+
+  struct ShortenedKey {
+    const TagStore* store;
+
+    std::u16string_view operator()(uint32_t id) const {
+      return store->strings.get(store->records[id].shortened);
+    }
+  };
+
+  // The first live row with word, or NO_ROW.
+  uint32_t findWord(std::string_view word) const {
+    const uint32_t id = wordRows.find(word, WordKey{this}, [&](uint32_t id) {
+      return isLive(id);
+    });
+    return id == RowHashTable::EMPTY ? NO_ROW : id;
+  }
+
+  // The live canonical row keyed by word, or NO_ROW.
+  uint32_t canonicalRow(const std::string& word) const {
+    const uint32_t id = findWord(word);
+    return id != NO_ROW && records[id].redirect == NO_REDIRECT ? id : NO_ROW;
+  }
+
+  // Points the aliases of word at its current canonical row after that row
+  // was added, removed or turned into an alias, in time linear in the
+  // aliases.
+  void relinkAliases(const std::string& word) {
+    const auto it = redirectSlots.find(word);
+    if (it == redirectSlots.end() || it->second == NO_REDIRECT || it->second >= aliasHeads.size()) {
+      return;
+    }
+    const uint32_t target = canonicalRow(word);
+    for (uint32_t id = aliasHeads[it->second]; id != NO_ROW; id = aliasLinks[id].next) {
+      canonical[id] = target;
+    }
+  }
+
+  // Raises the bounds of the blocks up to id's to cover its new priority and
+  // freq. Bounds never drop, so a lowered freq only leaves them loose.
+  void raiseBound(uint32_t id) {
+    const RankBound row{records[id].priority, (int32_t)records[id].freq};
+    for (uint32_t block = id / BOUND_ROWS + 1; block-- > 0;) {
+      RankBound& bound = bounds[block];
+      if (std::tie(row.priority, row.freq) <= std::tie(bound.priority, bound.freq)) {
+        break;
+      }
+      bound = row;
+    }
+  }
+
+  bool isGapFree(std::u16string_view query, uint32_t id) const {
+    const std::u16string_view shortened = strings.get(records[id].shortened);
+    return (beginsWith(shortened, query) || endsWith(shortened, query)) &&
+           (beginsWith(normalized[id], query) || endsWith(normalized[id], query));
+  }
+
+  bool matchesRow(std::u16string_view query, uint64_t signature, uint32_t id) const {
+    return (index.signatures[id] & signature) == signature && isSubsequence(query, normalized[id]) && isLive(id);
+  }
+
+  // Appends the matching rows from begin on whose initials begin or end with
+  // query, in row order and within scanBudget, and sets ahead to the rows of
+  // ids from begin on, sorted. An alias brings its canonical row along when
+  // that matches too, so rank() drops the alias as it would after a full
+  // scan. These rows score 0 against the shortened form and rank first, so
+  // no budget can cut them off. Returns true when, with every row indexed,
+  // resultLimit of them beat anything a scan could add.
+  bool collectInitials(std::u16string_view query, uint32_t begin, std::vector<uint32_t>& ids, const SearchOptions& options, std::vector<uint32_t>& ahead, SearchCounters* counters) const {
+    const uint64_t signature = calcSignature(query);
+    std::vector<uint32_t> found;
+    if (!query.empty() && query.find(u' ') == std::u16string_view::npos) {
+      initials.find(query, ShortenedKey{this}, found);
+    }
+    thread_local RowMarks collected;
+    collected.clear(size());
+    for (uint32_t id : ids) {
+      collected.mark(id);
+    }
+    size_t added = 0, leaders = 0;
+    bool truncated = false;
+    const auto add = [&](uint32_t id) {
+      if (collected.marked(id)) {
+        return;
+      }
+      if (ids.size() >= options.scanBudget) {
+        truncated = true;
+        return;
+      }
+      collected.mark(id);
+      ids.push_back(id);
+      added++;
+    };
+    const auto visit = [&](uint32_t id) {
+      if (id < begin || !matchesRow(query, signature, id)) {
+        return;
+      }
+      add(id);
+      const uint32_t target = canonical[id];
+      if (records[id].redirect != NO_REDIRECT && target != NO_ROW && matchesRow(query, signature, target)) {
+        if (target >= begin) {
+          add(target);
+        }
+      } else if (options.scoreShortened && isGapFreeShortened(query, id)) {
+        leaders++;
+      }
+    };
+    if (found.size() * DENSE_INITIALS_RATIO < size()) {
+      std::sort(found.begin(), found.end());
+      found.erase(std::unique(found.begin(), found.end()), found.end());
+      for (size_t i = 0; i < found.size() && !truncated; i++) {
+        visit(found[i]);
+      }
+    } else {
+      // The ranges of a single letter span a good part of the rows. Walking
+      // the rows puts them in order for less than sorting, and touches them
+      // in order too.
+      thread_local RowMarks hits;
+      hits.clear(size());
+      for (uint32_t id : found) {
+        hits.mark(id);
+      }
+      for (uint32_t id = begin; id < size() && !truncated; id++) {
+        if (hits.marked(id)) {
+          visit(id);
+        }
+      }
+    }
+    ahead.clear();
+    for (uint32_t id : ids) {
+      if (id >= begin) {
+        ahead.push_back(id);
+      }
+    }
+    std::sort(ahead.begin(), ahead.end());
+    // Without spaces in the query the index finds every row whose shortened
+    // form begins or ends with it, and those outrank all others.
+    const bool settled = begin == 0 && !truncated && leaders >= options.resultLimit && initials.rows() == size();
+    if (counters) {
+      counters->initialsRows += added;
+      counters->initialsOnly += settled;
+    }
+    return settled;
+  }
+
+  bool isGapFreeShortened(std::u16string_view query, uint32_t id) const {
+    const std::u16string_view shortened = strings.get(records[id].shortened);
+    return beginsWith(shortened, query) || endsWith(shortened, query);
+  }
+
+  // Whether the rows from `row` on can no longer change the top `limit`.
+  // Nothing after row scores better than (0, 0, bounds[row / BOUND_ROWS]), and
+  // later rows lose ties, so the scan can stop once `limit` leaders reach that
+  // score and are certain to survive the alias filter. Leaders the initials
+  // index put ahead of row may still lose a tie, so they only count once the
+  // scan passed them. An alias whose canonical row matches the query but lies
+  // ahead may still be dropped, so while one of those reaches the bound the
+  // scan goes on.
+  bool canStop(std::u16string_view query, const std::vector<uint32_t>& leaders, uint32_t row, size_t limit) const {
+    const uint32_t block = row / BOUND_ROWS;
+    const RankBound bound{bounds[block].priority + (boosts ? boosts->from(block) : 0), bounds[block].freq};
+    size_t certain = 0;
+    for (uint32_t id : leaders) {
+      const WordRecord& record = records[id];
+      if (id >= row || std::make_pair(priorityOf(id), (int32_t)record.freq) < std::make_pair(bound.priority, bound.freq)) {
+        continue;
+      }
+      const uint32_t target = canonical[id];
+      if (record.redirect != NO_REDIRECT && target != NO_ROW && isSubsequence(query, normalized[target])) {
+        if (target >= row) {
+          return false;
+        }
+        continue;
+      }
+      certain++;
+    }
+    return certain >= limit;
+  }
+
+  // collect() from row 0 for each query of pending at once. Every row is
+  // tested against all queries still scanning, and each query drops out
+  // where its own serial collect() would stop. Running out of time stops
+  // them all.
+  void collectShared(const std::vector<std::u16string>& queries, const std::vector<size_t>& pending, std::vector<std::vector<uint32_t>>& ids, const SearchOptions& options) const {
+    const size_t limit = options.resultLimit;
+    const ScanDeadline deadline(options.timeBudgetMs);
+    struct Scan {
+      size_t query;
+      uint64_t signature;
+      std::vector<uint32_t> leaders;
+      // Rows the initials index collected, sorted.
+      std::vector<uint32_t> ahead;
+    };
+    std::vector<Scan> active;
+    for (size_t q : pending) {
+      Scan scan{q, calcSignature(queries[q]), {}, {}};
+      if (collectInitials(queries[q], 0, ids[q], options, scan.ahead, nullptr) || ids[q].size() >= options.scanBudget) {
+        continue;
+      }
+      for (uint32_t id : ids[q]) {
+        if (isGapFree(queries[q], id)) {
+          scan.leaders.push_back(id);
+        }
+      }
+      active.push_back(std::move(scan));
+    }
+    for (uint32_t id = 0; id < size() && !active.empty(); id++) {
+      if ((id + 1) % CANCEL_CHECK_INTERVAL == 0 && deadline.passed()) {
+        break;
+      }
+      const bool blockStart = id % BOUND_ROWS == 0;
+      const bool live = isLive(id);
+      for (size_t i = 0; i < active.size();) {
+        Scan& scan = active[i];
+        const std::u16string_view query = queries[scan.query];
+        bool done = blockStart && scan.leaders.size() >= limit && canStop(query, scan.leaders, id, limit);
+        if (!done && live && (index.signatures[id] & scan.signature) == scan.signature && isSubsequence(query, normalized[id]) &&
+            !std::binary_search(scan.ahead.begin(), scan.ahead.end(), id)) {
+          ids[scan.query].push_back(id);
+          if (isGapFree(query, id)) {
+            scan.leaders.push_back(id);
+          }
+          done = ids[scan.query].size() >= options.scanBudget;
+        }
+        if (done) {
+          active[i] = std::move(active.back());
+          active.pop_back();
+        } else {
+          i++;
+        }
+      }
+    }
+  }
+
+  // A candidate's rank key: the gap scores against shortened and normalized,
+  // then priority and freq, highest first. row breaks ties.
+  struct Ranked {
+    std::tuple<int, int, int, int> score;
+    uint32_t row;
+
+    bool operator<(const Ranked& other) const {
+      return std::tie(score, row) < std::tie(other.score, other.row);
+    }
+  };
+};
+
+struct QueryCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  // Entries dropped to stay within the budget.
+  uint64_t evictions = 0;
+  // Entries dropped because their store was reloaded or updated.
+  uint64_t invalidations = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+  size_t budget = 0;
+
+  std::vector<std::pair<std::string, double>> fields() const {
+    return {
+      {"hits", double(hits)},
+      {"misses", double(misses)},
+      {"evictions", double(evictions)},
+      {"invalidations", double(invalidations)},
+      {"entries", double(entries)},
+      {"bytes", double(bytes)},
+      {"budget", double(budget)},
+    };
+  }
+};
+
+// Ranked rows of recent queries, keyed by normalized query and evicted least
+// recently used first once they pass the byte budget. Each entry remembers
+// the generation of the store it was ranked on and only answers for that
+// store, so reloads and updates need no flush: stale entries are dropped
+// when looked up or age out. Changes that keep the store but rank it
+// differently, new options or usage boosts, clear() it instead.
+class QueryCache {
+public:
+  static constexpr size_t DEFAULT_BUDGET = 1 << 20;
+  // Bytes an entry takes besides its query and rows: the list node, the map
+  // node and its bucket.
+  static constexpr size_t ENTRY_OVERHEAD = 128;
+
+  bool find(std::u16string_view query, uint64_t generation, std::vector<uint32_t>& ids) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = entries.find(query);
+    if (it == entries.end()) {
+      counters.misses++;
+      return false;
+    }
+    if (it->second->generation != generation) {
+      erase(it->second);
+      counters.invalidations++;
+      counters.misses++;
+      return false;
+    }
+    order.splice(order.begin(), order, it->second);
+    ids = it->second->ids;
+    counters.hits++;
+    return true;
+  }
+
+  // A search reads epoch() before the options and boosts it ranks with and
+  // inserts with it, so results ranked before a clear() are dropped instead
+  // of cached after it.
+  uint64_t epoch() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return currentEpoch;
+  }
+
+  void insert(std::u16string query, uint64_t generation, uint64_t epoch, std::vector<uint32_t> ids) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (epoch != currentEpoch) {
+      return;
+    }
+    const auto it = entries.find(query);
+    if (it != entries.end()) {
+      erase(it->second);
+    }
+    Entry entry{std::move(query), generation, std::move(ids)};
+    if (entry.bytes() > budget) {
+      return;
+    }
+    bytes += entry.bytes();
+    order.push_front(std::move(entry));
+    entries.emplace(order.front().query, order.begin());
+    trim();
+  }
+
+  void setBudget(size_t newBudget) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = newBudget;
+    trim();
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    currentEpoch++;
+    counters.invalidations += order.size();
+    entries.clear();
+    order.clear();
+    bytes = 0;
+  }
+
+  QueryCacheStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    QueryCacheStats result = counters;
+    result.entries = order.size();
+    result.bytes = bytes;
+    result.budget = budget;
+    return result;
+  }
+
+private:
+  struct Entry {
+    std::u16string query;
+    uint64_t generation;
+    std::vector<uint32_t> ids;
+
+    size_t bytes() const {
+      return ENTRY_OVERHEAD + query.capacity() * sizeof(char16_t) + ids.capacity() * sizeof(uint32_t);
+    }
+  };
+
+  mutable std::mutex mutex;
+  // Most recently used first. The map keys view the queries in the list.
+  std::list<Entry> order;
+  std::unordered_map<std::u16string_view, std::list<Entry>::iterator> entries;
+  size_t bytes = 0;
+  size_t budget = DEFAULT_BUDGET;
+  uint64_t currentEpoch = 0;
+  QueryCacheStats counters;
+
+  void erase(std::list<Entry>::iterator entry) {
+    bytes -= entry->bytes();
+    entries.erase(entry->query);
+    order.erase(entry);
+  }
+
+  void trim() {
+    while (bytes > budget) {
+      erase(std::prev(order.end()));
+      counters.evictions++;
+    }
+  }
+};
+
+// A named, reloadable TagStore. Loads may run on a different thread than
+// searches: a searcher takes current() and keeps it for as long as it uses
+// the returned Words, while load() and loadSnapshot() build the new store
+// off to the side and only swap the pointer. batchApply() only changes a
+// store in place that no searcher holds.
+class Database {
+public:
+  std::string name;
+  // Threads used by load(), 0 picks one per core and 1 parses on the calling
+  // thread.
+  std::atomic<size_t> loadThreads{0};
+  // Whether load() lays the rows out by descending freq (see
+  // orderByFrequency()) rather than in CSV order.
+  std::atomic<bool> frequencyOrder{true};
+  Database(const std::string& name, const SearchOptions& options = SearchOptions()) : name(name), store(std::make_shared<TagStore>()), cache(std::make_shared<QueryCache>()), stats(std::make_shared<SearchStats>()), options(options) {}
+
+  std::shared_ptr<const TagStore> current() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return store;
+  }
+
+  // Threads a single search may use, counting the calling thread. With 1,
+  // the default, searches run on the calling thread only.
+  void setSearchThreads(size_t threads) {
+    auto newPool = threads > 1 ? std::make_shared<ThreadPool>(threads) : nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    pool = std::move(newPool);
+  }
+
+  // Null when searches should not be split.
+  std::shared_ptr<ThreadPool> searchPool() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pool;
+  }
+
+  // Shared so that a search running when the database is released can
+  // still finish with it.
+  std::shared_ptr<QueryCache> queryCache() const {
+    return cache;
+  }
+
+  void setCacheBudget(size_t bytes) {
+    cache->setBudget(bytes);
+  }
+
+  QueryCacheStats cacheStats() const {
+    return cache->stats();
+  }
+
+  // Shared for the same reason as queryCache().
+  std::shared_ptr<SearchStats> searchStats() const {
+    return stats;
+  }
+
+  SearchOptions searchOptions() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return options;
+  }
+
+  // Cached results were ranked under the old options, so they are dropped.
+  void setSearchOptions(const SearchOptions& newOptions) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      options = newOptions;
+    }
+    cache->clear();
+  }
+
+  // The query cache when a search with `requested` options, null for the
+  // database's own, may use it.
+  QueryCache* cacheFor(const SearchOptions* requested) const {
+    return !requested || *requested == searchOptions() ? cache.get() : nullptr;
+  }
+
+  // store->search() with the database's options unless `requested` are
+  // given. Answered from the query cache when store was searched for the
+  // same normalized query before with the same options, and recorded in
+  // searchStats().
+  std::vector<Word> search(const TagStore& searched, const std::string& word, const SearchCancel* cancel = nullptr, const SearchOptions* requested = nullptr) const {
+    SearchStats* recorded = stats->enabled() ? stats.get() : nullptr;
+    PhaseTimer timer(recorded);
+    const std::u16string query = normalizeUtf16(word);
+    timer.lap(SearchPhase::Normalize);
+    const uint64_t epoch = cache->epoch();
+    const SearchOptions used = requested ? *requested : searchOptions();
+    QueryCache* cached = cacheFor(requested);
+    std::vector<uint32_t> ids;
+    if (cached && cached->find(query, searched.generation, ids)) {
+      return searched.getWords(ids);
+    }
+    SearchCounters counters;
+    const auto pool = searchPool();
+    searched.collect(query, 0, ids, cancel, pool.get(), used, &counters);
+    timer.lap(SearchPhase::Collect);
+    if (cancel && cancel->cancelled()) {
+      return {};
+    }
+    std::vector<Word> result = searched.rank(query, ids, pool.get(), used, &counters);
+    timer.lap(SearchPhase::Rank);
+    if (searched.appendFuzzy(query, result, cancel, used, &counters)) {
+      timer.lap(SearchPhase::Fuzzy);
+    }
+    if (cancel && cancel->cancelled()) {
+      return {};
+    }
+    if (recorded) {
+      recorded->add(counters);
+    }
+    // A scan cut short by a time budget may finish next time.
+    if (cached && counters.timeouts == 0 && counters.fuzzyTimeouts == 0) {
+      cached->insert(query, searched.generation, epoch, TagStore::rowsOf(result));
+    }
+    return result;
+  }
+
+  // Orders the lines of csvData by frequency unless frequencyOrder is off,
+  // parses them in equal runs on loadThreads threads, each into its own
+  // arenas, then merges the runs in order.
+  void load(const std::string& csvData) {
+    std::lock_guard<std::mutex> loading(loadMutex);
+    loadText(csvData, false);
+  }
+
+  // Like loadWithSnapshot(), but reads the CSV file at path through a memory
+  // map instead of taking it as a string, and publishes the rows in growing
+  // batches as they are parsed, the most frequent first. Searches made
+  // meanwhile run over the rows loaded so far; the stores published before
+  // the last batch have loadStats.complete unset. Without snapshotPath no
+  // snapshot is read or written. Returns false when the file is missing or
+  // empty.
+  bool loadFile(const std::string& path, const std::string& snapshotPath = std::string()) {
+    const MappedFile file(path);
+    if (!file.data()) {
+      return false;
+    }
+    const std::string_view text(file.data(), file.size());
+    const uint64_t hash = hashBytes(text.data(), text.size());
+    std::lock_guard<std::mutex> loading(loadMutex);
+    if (!snapshotPath.empty() && readSnapshot(snapshotPath, hash)) {
+      return true;
+    }
+    loadText(text, true);
+    if (!snapshotPath.empty()) {
+      saveSnapshot(snapshotPath, hash);
+    }
+    return true;
+  }
+
+  // Loads the snapshot at snapshotPath if it was built from csvData, and
+  // otherwise parses csvData and writes a fresh snapshot for next time.
+  void loadWithSnapshot(const std::string& csvData, const std::string& snapshotPath) {
+    const uint64_t hash = sourceHash(csvData);
+    std::lock_guard<std::mutex> loading(loadMutex);
+    if (readSnapshot(snapshotPath, hash)) {
+      return;
+    }
+    loadText(csvData, false);
+    saveSnapshot(snapshotPath, hash);
+  }
+
+  bool saveSnapshot(const std::string& path, uint64_t sourceHash) const {
+    std::shared_ptr<const TagStore> store = current();
+    // It would pass for the whole source on the next start.
+    if (!store->loadStats.complete) {
+      return false;
+    }
+    // Snapshots hold no removed or unindexed rows.
+    if (!store->isCompact()) {
+      auto compacted = std::make_shared<TagStore>(*store);
+      compacted->compact();
+      store = std::move(compacted);
+    }
+    SnapshotWriter writer;
+    store->write(writer);
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, "SDSTAGDB", sizeof(header.magic));
+    header.version = SnapshotHeader::VERSION;
+    header.byteOrder = SnapshotHeader::ENDIAN_MARK;
+    header.recordSize = sizeof(WordRecord);
+    header.rows = store->size();
+    header.sourceHash = sourceHash;
+    header.payloadHash = hashBytes(writer.payload.data(), writer.payload.size());
+    header.payloadSize = writer.payload.size();
+
+    // Write next to the target and rename so a reader never maps a partial
+    // file.
+    const std::string tmpPath = path + ".tmp";
+    {
+      std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out.write(writer.payload.data(), writer.payload.size());
+      if (!out) {
+        return false;
+      }
+    }
+#ifdef _WIN32
+    // rename() does not replace an existing file here, as it does atomically
+    // on POSIX, so there is a moment without one.
+    std::remove(path.c_str());
+#endif
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+  }
+
+  // Returns false and leaves the database untouched when the snapshot is
+  // missing, corrupt, from another version or built from a different source.
+  // Waits for a load in progress, whose next batch would replace it.
+  bool loadSnapshot(const std::string& path, uint64_t sourceHash) {
+    std::lock_guard<std::mutex> loading(loadMutex);
+    return readSnapshot(path, sourceHash);
+  }
+
+  bool upsert(const TagUpdate& update) {
+    return batchApply({update}) == 1;
+  }
+
+  bool remove(const std::string& word) {
+    TagUpdate update;
+    update.remove = true;
+    update.word = word;
+    return batchApply({update}) == 1;
+  }
+
+  // Applies updates in order and publishes the result as one change, so a
+  // search sees all of them or none. Returns how many took effect; removing
+  // a word that is not loaded or an over-long field does not. Searches go
+  // on over the current store while a copy is updated, and compacted once
+  // enough rows went stale, and only wait for the swap, as with publish().
+  // A store no search holds and that the updates cannot make stale enough to
+  // compact is changed in place instead, with searches waiting for the edits.
+  // Waits for a load in progress, whose next store would drop the updates.
+  size_t batchApply(const std::vector<TagUpdate>& updates) {
+    std::lock_guard<std::mutex> loading(loadMutex);
+    std::lock_guard<std::mutex> usageLock(usageMutex);
+    std::shared_ptr<TagStore> next;
+    {
+      // current() hands the store out under this lock, so no search can
+      // take it before the edits are published.
+      std::lock_guard<std::mutex> lock(mutex);
+      if (store.use_count() == 1 && !store->needsCompaction(updates.size())) {
+        const size_t applied = applyUpdates(*store, updates);
+        // Rows were added.
+        store->attachUsage(usage, unixSeconds());
+        store->generation = ++generation;
+        return applied;
+      }
+      next = store;
+    }
+    // Only loads and batches replace the store, and they wait for
+    // loadMutex.
+    next = std::make_shared<TagStore>(*next);
+    const size_t applied = applyUpdates(*next, updates);
+    if (next->needsCompaction()) {
+      next->compact();
+    }
+    // Rows were added or renumbered.
+    next->attachUsage(usage, unixSeconds());
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      next->generation = ++generation;
+      store.swap(next);
+    }
+    // The old store is freed here, outside the lock, unless a search
+    // still holds it.
+    next.reset();
+    return applied;
+  }
+
+  // Counts tag, as written or normalized, as a completion the user
+  // accepted, which raises the priority its canonical row ranks with from
+  // the next search on. Returns false when tag is not loaded.
+  bool recordUsage(const std::string& tag) {
+    {
+      std::lock_guard<std::mutex> lock(usageMutex);
+      const auto searched = current();
+      const uint32_t row = searched->usageRow(tag);
+      if (row == TagStore::NO_ROW) {
+        return false;
+      }
+      searched->boostRow(row, usage.record(searched->usageKey(row), unixSeconds()));
+    }
+    // Cached results were ranked without it.
+    cache->clear();
+    return true;
+  }
+
+  bool saveUsage(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(usageMutex);
+    return usage.save(path, unixSeconds());
+  }
+
+  // Replaces the usage counts with those saved at path, which need not come
+  // from the same load or version of the CSV. Returns false and keeps the
+  // counts when the file is missing or corrupt.
+  bool loadUsage(const std::string& path) {
+    {
+      std::lock_guard<std::mutex> lock(usageMutex);
+      if (!usage.load(path)) {
+        return false;
+      }
+      current()->applyUsage(usage, unixSeconds());
+    }
+    cache->clear();
+    return true;
+  }
+
+  uint32_t size() const {
+    return current()->size();
+  }
+
+  MemoryUsage memoryUsage() const {
+    return current()->memoryUsage();
+  }
+
+  LoadStats loadStats() const {
+    return current()->loadStats;
+  }
+
+private:
+  mutable std::mutex mutex;
+  // Held for a whole load, which publishes several stores when streaming,
+  // and while a snapshot is read, so that loads do not interleave.
+  std::mutex loadMutex;
+  // Guards usage and the boosts of the current store. Taken before mutex.
+  mutable std::mutex usageMutex;
+  TagUsage usage;
+  std::shared_ptr<TagStore> store;
+  std::shared_ptr<ThreadPool> pool;
+  std::shared_ptr<QueryCache> cache;
+  std::shared_ptr<SearchStats> stats;
+  SearchOptions options;
+  uint64_t generation = 0;
+
+  // loadSnapshot() with loadMutex held.
+  bool readSnapshot(const std::string& path, uint64_t sourceHash) {
+    const auto start = std::chrono::steady_clock::now();
+    MappedFile file(path);
+    SnapshotHeader header;
+    if (file.size() < sizeof(header)) {
+      return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, "SDSTAGDB", sizeof(header.magic)) != 0 ||
+        header.version != SnapshotHeader::VERSION ||
+        header.byteOrder != SnapshotHeader::ENDIAN_MARK ||
+        header.recordSize != sizeof(WordRecord) ||
+        header.sourceHash != sourceHash ||
+        header.payloadSize != file.size() - sizeof(header)) {
+      return false;
+    }
+    const char* payload = file.data() + sizeof(header);
+    if (hashBytes(payload, header.payloadSize) != header.payloadHash) {
+      return false;
+    }
+    auto newStore = std::make_shared<TagStore>();
+    SnapshotReader reader(payload, header.payloadSize);
+    if (!newStore->read(reader, header.rows)) {
+      return false;
+    }
+    LoadStats& stats = newStore->loadStats;
+    stats.rows = header.rows;
+    stats.bytes = file.size();
+    stats.fromSnapshot = true;
+    stats.danglingRedirects = newStore->danglingRedirects().size();
+    stats.totalNs = elapsedNs(start);
+    publish(std::move(newStore));
+    return true;
+  }
+
+  static size_t applyUpdates(TagStore& target, const std::vector<TagUpdate>& updates) {
+    size_t applied = 0;
+    for (const auto& update : updates) {
+      applied += update.remove ? target.remove(update.word) : target.upsert(update);
+    }
+    return applied;
+  }
+
+  void publish(std::shared_ptr<TagStore> newStore) {
+    std::lock_guard<std::mutex> usageLock(usageMutex);
+    newStore->attachUsage(usage, unixSeconds());
+    std::lock_guard<std::mutex> lock(mutex);
+    newStore->generation = ++generation;
+    store = std::move(newStore);
+  }
+
+  // With stream, the first batch is FIRST_BATCH_ROWS lines and each later
+  // one BATCH_GROWTH - 1 times the lines before it, and a store is built and
+  // published after every batch. Rebuilding the stores adds about a quarter
+  // to the load time. Called with loadMutex held.
+  void loadText(std::string_view text, bool stream) {
+    static constexpr size_t MIN_CHUNK_BYTES = 256 * 1024;
+    static constexpr size_t FIRST_BATCH_ROWS = 4096;
+    static constexpr size_t BATCH_GROWTH = 8;
+    const auto start = std::chrono::steady_clock::now();
+    LoadStats stats;
+    stats.bytes = text.size();
+
+    auto stage = std::chrono::steady_clock::now();
+    std::vector<std::string_view> lines = splitCsvLines(text);
+    stats.splitNs = elapsedNs(stage);
+
+    stage = std::chrono::steady_clock::now();
+    if (frequencyOrder) {
+      orderByFrequency(lines);
+    }
+    stats.orderNs = elapsedNs(stage);
+
+    const size_t requested = loadThreads;
+    const size_t maxThreads = requested ? requested : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<LoadChunk> chunks;
+    // The rows parsed so far. Each batch's chunks are freed as they are
+    // merged in, the stores published before the last copy the columns and
+    // the last takes them over, so parsed rows are not also kept in chunks
+    // for the rest of the load.
+    TagStore columns;
+    std::unordered_map<std::string_view, uint32_t> redirectIds;
+    size_t parsed = 0;
+    do {
+      const size_t end = stream ? std::min(lines.size(), std::max(FIRST_BATCH_ROWS, parsed * BATCH_GROWTH)) : lines.size();
+      stage = std::chrono::steady_clock::now();
+      const size_t batchBytes = text.size() * (end - parsed) / std::max<size_t>(1, lines.size());
+      const size_t threads = std::max<size_t>(1, std::min(maxThreads, batchBytes / MIN_CHUNK_BYTES));
+      parseLines(lines.data() + parsed, lines.data() + end, threads, chunks);
+      stats.threads = std::max(stats.threads, threads);
+      stats.parseNs += elapsedNs(stage);
+      parsed = end;
+
+      stage = std::chrono::steady_clock::now();
+      columns.merge(chunks, redirectIds);
+      auto newStore = parsed == lines.size() ? std::make_shared<TagStore>(std::move(columns)) : std::make_shared<TagStore>(columns);
+      stats.mergeNs += elapsedNs(stage);
+
+      stage = std::chrono::steady_clock::now();
+      newStore->index.build(newStore->normalized);
+      newStore->buildInitials();
+      newStore->buildRanking();
+      newStore->buildLookup();
+      stats.indexNs += elapsedNs(stage);
+      stats.rows = newStore->size();
+      stats.complete = parsed == lines.size();
+      stats.danglingRedirects = newStore->danglingRedirects().size();
+      stats.totalNs = elapsedNs(start);
+      newStore->loadStats = stats;
+      publish(std::move(newStore));
+    } while (parsed < lines.size());
+  }
+};
+
+// Per-keystroke search state. Typing mostly extends the previous query, and
+// every row matching the longer query also matches the shorter one, so the
+// previous candidates only need to be refined and the scan resumed from where
+// it stopped. Earlier states are kept on a stack for backspacing.
+class SearchSession {
+public:
+  static constexpr size_t MAX_STATES = 32;
+
+  int dbId;
+  SearchSession(int dbId) : dbId(dbId) {}
+
+  // Searches store, a version of db, with db's options unless `requested`
+  // are given, and uses db's search threads, query cache and stats. Returns
+  // nothing, and keeps no state, when cancelled. Searches on one session
+  // from several threads run one at a time. A query found in cache is
+  // answered from it and leaves the session as it was; the states kept are
+  // still valid starting points for the next query. A scan cut short by the
+  // time budget resumes where it stopped when the query is repeated or
+  // extended.
+  std::vector<Word> search(const Database& db, const TagStore& store, const std::string& word, const SearchCancel* cancel = nullptr, const SearchOptions* requested = nullptr) {
+    const auto dbStats = db.searchStats();
+    SearchStats* stats = dbStats->enabled() ? dbStats.get() : nullptr;
+    PhaseTimer timer(stats);
+    const std::u16string normalized = normalizeUtf16(word);
+    timer.lap(SearchPhase::Normalize);
+    const uint64_t epoch = db.queryCache()->epoch();
+    const SearchOptions options = requested ? *requested : db.searchOptions();
+    QueryCache* cache = db.cacheFor(requested);
+    std::vector<uint32_t> cached;
+    if (cache && cache->find(normalized, store.generation, cached)) {
+      return store.getWords(cached);
+    }
+    const auto pool = db.searchPool();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (generation != store.generation) {
+      states.clear();
+      generation = store.generation;
+    }
+    while (!states.empty() && !TagStore::isSubsequence(states.back().query, normalized)) {
+      states.pop_back();
+    }
+    SearchCounters counters;
+    State state{normalized, {}, 0};
+    if (!states.empty()) {
+      state.ids = states.back().ids;
+      state.cursor = states.back().cursor;
+      if (states.back().query == normalized) {
+        states.pop_back();
+      } else {
+        // Rows past the cursor came from the initials index for the old
+        // query; collect() looks up those of the new one.
+        state.ids.erase(std::remove_if(state.ids.begin(), state.ids.end(), [&](uint32_t id) {
+          return id >= state.cursor;
+        }), state.ids.end());
+        store.refine(normalized, state.ids, &counters);
+      }
+    }
+    state.cursor = store.collect(normalized, state.cursor, state.ids, cancel, pool.get(), options, &counters);
+    timer.lap(SearchPhase::Collect);
+    if (cancel && cancel->cancelled()) {
+      return {};
+    }
+    auto result = store.rank(normalized, state.ids, pool.get(), options, &counters);
+    timer.lap(SearchPhase::Rank);
+    if (store.appendFuzzy(normalized, result, cancel, options, &counters)) {
+      timer.lap(SearchPhase::Fuzzy);
+    }
+    if (cancel && cancel->cancelled()) {
+      return {};
+    }
+    if (stats) {
+      stats->add(counters);
+    }
+    if (cache && counters.timeouts == 0 && counters.fuzzyTimeouts == 0) {
+      cache->insert(normalized, store.generation, epoch, TagStore::rowsOf(result));
+    }
+    states.push_back(std::move(state));
+    if (states.size() > MAX_STATES) {
+      states.erase(states.begin());
+    }
+    return result;
+  }
+
+private:
+  struct State {
+    std::u16string query;
+    std::vector<uint32_t> ids;
+    uint32_t cursor;
+  };
+  std::mutex mutex;
+  std::vector<State> states;
+  uint64_t generation = 0;
+};
+
+// The databases and sessions the bindings refer to by id. Calls may arrive
+// on several threads (Capacitor runs plugin calls off the main thread), so
+// the maps are guarded by a mutex and hand out shared_ptrs: a database or
+// session released during a call stays alive until that call is done.
+// Unknown ids yield null rather than a new empty entry.
+class DatabaseRepository {
+public:
+  DatabaseRepository() = default;
+
+  int create(const std::string& name, const SearchOptions& options = SearchOptions()) {
+    auto db = std::make_shared<Database>(name, options);
+    std::lock_guard<std::mutex> lock(mutex);
+    databases[nextId] = std::move(db);
+    return nextId++;
+  }
+
+  std::shared_ptr<Database> get(int id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = databases.find(id);
+    return it == databases.end() ? nullptr : it->second;
+  }
+
+  // Also drops the database's sessions. Returns false for an unknown id.
+  bool release(int id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (databases.erase(id) == 0) {
+      return false;
+    }
+    for (auto it = sessions.begin(); it != sessions.end();) {
+      if (it->second->dbId == id) {
+        it = sessions.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return true;
+  }
+
+  bool saveSnapshot(int id, const std::string& path, uint64_t sourceHash) const {
+    const auto db = get(id);
+    return db && db->saveSnapshot(path, sourceHash);
+  }
+
+  bool loadSnapshot(int id, const std::string& path, uint64_t sourceHash) {
+    const auto db = get(id);
+    return db && db->loadSnapshot(path, sourceHash);
+  }
+
+  // Returns -1 when dbId is unknown.
+  int createSession(int dbId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (databases.find(dbId) == databases.end()) {
+      return -1;
+    }
+    sessions[nextSessionId] = std::make_shared<SearchSession>(dbId);
+    return nextSessionId++;
+  }
+
+  std::shared_ptr<SearchSession> getSession(int id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = sessions.find(id);
+    return it == sessions.end() ? nullptr : it->second;
+  }
+
+  bool releaseSession(int id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sessions.erase(id) != 0;
+  }
+
+private:
+  mutable std::mutex mutex;
+  std::map<int, std::shared_ptr<Database>> databases;
+  std::map<int, std::shared_ptr<SearchSession>> sessions;
+  int nextId = 0;
+  int nextSessionId = 0;
 };
@@ -0,0 +1,236 @@
+// Searches a Database from several threads, through Database::search and
+// SearchSession, while other threads reload it from a string, stream it in
+// from a file, load snapshots, apply updates, record usage and change its
+// options. Every result must come from the store it was searched on, and
+// once the threads are done the updates must all be in the current store
+// and the query cache must agree with a fresh search of it, also right
+// after a usage boost lands mid-search. Build with TAGDB_TSAN to have
+// ThreadSanitizer check the store swaps, the cache and the streaming loader:
+//
+//   cmake -S src/native/tests -B src/native/tests/build -DTAGDB_TSAN=ON
+//   cmake --build src/native/tests/build
+//   ctest --test-dir src/native/tests/build
+
+#include "tagdb.hpp"
+
+#include <filesystem>
+
+namespace {
+
+constexpr size_t FILE_ROWS = 12000;
+constexpr size_t TEXT_ROWS = 6000;
+constexpr int RELOADS = 6;
+constexpr int UPDATES = 200;
+constexpr int USES = 300;
+constexpr int USAGE_ROUNDS = 40;
+
+const std::vector<std::string> QUERIES = {
+  "1girl", "hair", "long hair", "blue", "sky", "a", "gril", "ㄱ", "하", "머리", "ㅎㄱ", "smile",
+};
+
+std::atomic<int> failures{0};
+
+void fail(const std::string& message) {
+  if (failures++ < 10) {
+    std::cerr << message << "\n";
+  }
+}
+
+// The first rows lines of the CSV at path.
+std::string readRows(const std::string& path, size_t rows) {
+  std::ifstream file(path, std::ios::binary);
+  std::string text, line;
+  for (size_t i = 0; i < rows && std::getline(file, line); i++) {
+    text += line;
+    text += '\n';
+  }
+  return text;
+}
+
+bool writeFile(const std::string& path, const std::string& text) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << text;
+  return bool(out);
+}
+
+// Each row of result must be a live row of the store searched.
+void checkResult(const TagStore& store, const std::vector<Word>& result, const std::string& query) {
+  for (const Word& word : result) {
+    if (word.id >= store.size() || word.word.empty()) {
+      fail("bad row " + std::to_string(word.id) + " for " + query);
+      return;
+    }
+  }
+}
+
+void searchLoop(Database& db, const std::atomic<bool>& done) {
+  SearchSession session(0);
+  while (!done) {
+    for (const auto& query : QUERIES) {
+      const auto store = db.current();
+      checkResult(*store, db.search(*store, query), query);
+      // Typed one character at a time, as the session expects.
+      std::string typed;
+      for (char ch : query) {
+        typed += ch;
+        checkResult(*store, session.search(db, *store, typed), typed);
+      }
+    }
+  }
+}
+
+// Searches query on db from a few threads while a row of its results gets
+// boosted, then checks that the cache holds no results ranked before the
+// boost.
+void usageRound(Database& db, const std::string& query, int round) {
+  const auto store = db.current();
+  const auto before = store->search(query, nullptr, nullptr, db.searchOptions());
+  if (before.size() < 2) {
+    return;
+  }
+  // A row ranked low enough that a boost moves it, and not boosted yet.
+  const std::string boosted = utf16ToUtf8(before[before.size() - 1 - round % (before.size() / 2)].word);
+  std::atomic<bool> done{false};
+  std::vector<std::thread> searchers;
+  for (int i = 0; i < 3; i++) {
+    searchers.emplace_back([&] {
+      while (!done) {
+        db.search(*store, query);
+      }
+    });
+  }
+  // Clearing keeps the searchers ranking rather than answering from cache,
+  // so that some are midway when the boost lands.
+  for (int i = 0; i < 20; i++) {
+    db.setSearchOptions(db.searchOptions());
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  db.recordUsage(boosted);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  done = true;
+  for (auto& searcher : searchers) {
+    searcher.join();
+  }
+  const auto fresh = TagStore::rowsOf(store->search(query, nullptr, nullptr, db.searchOptions()));
+  if (TagStore::rowsOf(db.search(*store, query)) != fresh) {
+    fail("cached results ranked before a usage boost for " + query);
+  }
+}
+
+} // namespace
+
+int main() {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "tagdb_concurrency_test";
+  std::filesystem::create_directories(dir);
+  const std::string csvPath = (dir / "tags.csv").string();
+  const std::string snapshotPath = (dir / "tags.snapshot").string();
+  const std::string usagePath = (dir / "tags.usage").string();
+  const std::string fileText = readRows(TAGDB_TEST_CSV, FILE_ROWS);
+  const std::string text = readRows(TAGDB_TEST_CSV, TEXT_ROWS);
+  if (fileText.empty() || !writeFile(csvPath, fileText)) {
+    std::cerr << "cannot read " << TAGDB_TEST_CSV << " or write " << csvPath << "\n";
+    return 1;
+  }
+  std::filesystem::remove(snapshotPath);
+
+  // No time budgets, so that a search repeated after the threads stop
+  // finds the same rows as the cached one.
+  SearchOptions options;
+  options.fuzzyResults = 8;
+  options.fuzzyTimeBudgetMs = 0;
+  Database db("stress", options);
+  db.setSearchThreads(2);
+  db.load(text);
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> searchers;
+  for (int i = 0; i < 3; i++) {
+    searchers.emplace_back(searchLoop, std::ref(db), std::cref(done));
+  }
+
+  std::vector<std::thread> writers;
+  writers.emplace_back([&] {
+    const uint64_t hash = hashBytes(fileText.data(), fileText.size());
+    for (int i = 0; i < RELOADS; i++) {
+      db.load(text);
+      if (!db.loadFile(csvPath, snapshotPath)) {
+        fail("loadFile failed");
+      }
+      db.loadSnapshot(snapshotPath, hash);
+    }
+  });
+  writers.emplace_back([&] {
+    for (int i = 0; i < UPDATES; i++) {
+      TagUpdate update;
+      update.word = "stress tag " + std::to_string(i % 20);
+      update.freq = i;
+      update.remove = i % 3 == 2;
+      db.batchApply({update});
+    }
+  });
+  writers.emplace_back([&] {
+    for (int i = 0; i < USES; i++) {
+      db.recordUsage(QUERIES[i % QUERIES.size()]);
+      if (i % 50 == 49) {
+        db.saveUsage(usagePath);
+        db.loadUsage(usagePath);
+      }
+    }
+  });
+  writers.emplace_back([&] {
+    for (int i = 0; i < 20; i++) {
+      SearchOptions changed = options;
+      changed.resultLimit = i % 2 ? 64 : options.resultLimit;
+      db.setSearchOptions(changed);
+      db.setCacheBudget(i % 2 ? 4096 : QueryCache::DEFAULT_BUDGET);
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    db.setSearchOptions(options);
+  });
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  done = true;
+  for (auto& searcher : searchers) {
+    searcher.join();
+  }
+
+  // Updated again after the loads, so that all of them land in the store
+  // the last load left.
+  std::vector<TagUpdate> updates;
+  for (int i = 0; i < 20; i++) {
+    TagUpdate update;
+    update.word = "stress tag " + std::to_string(i);
+    update.freq = i;
+    update.remove = i % 2 == 1;
+    updates.push_back(update);
+  }
+  db.batchApply(updates);
+  const auto store = db.current();
+  if (!store->loadStats.complete) {
+    fail("the last load left a partial store");
+  }
+  for (const auto& query : QUERIES) {
+    const auto fresh = TagStore::rowsOf(store->search(query, nullptr, nullptr, db.searchOptions()));
+    if (TagStore::rowsOf(db.search(*store, query)) != fresh) {
+      fail("cached results differ from a fresh search for " + query);
+    }
+  }
+  for (const auto& update : updates) {
+    const auto result = store->search(update.word);
+    const bool found = !result.empty() && utf16ToUtf8(result[0].word) == update.word;
+    if (found == update.remove) {
+      fail(update.word + (update.remove ? " was not removed" : " is missing"));
+    }
+  }
+  for (int round = 0; round < USAGE_ROUNDS; round++) {
+    usageRound(db, QUERIES[round % 3], round);
+  }
+  std::filesystem::remove_all(dir);
+  if (failures) {
+    std::cerr << failures << " failures\n";
+    return 1;
+  }
+  std::cout << "ok\n";
+  return 0;
+}
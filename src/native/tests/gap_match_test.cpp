@@ -0,0 +1,78 @@
+// Checks calcGapMatch() against the dynamic program it replaced, on random
+// words over small alphabets so that repeated characters, partial matches
+// and misses all come up often.
+//
+//   cmake -S src/native/tests -B src/native/tests/build
+//   cmake --build src/native/tests/build
+//   ctest --test-dir src/native/tests/build
+
+#include "tagdb.hpp"
+
+#include <random>
+
+namespace {
+
+// The DP table version of calcGapMatch(), kept as the reference. Only
+// changed to stop reading small[m].
+int referenceGapMatch(std::u16string_view small, std::u16string_view large) {
+  if (beginsWith(large, small) || endsWith(large, small)) {
+    return 0;
+  }
+  const int inf = 1e9;
+  if (small.size() > MAX_WORD_LEN || large.size() > MAX_WORD_LEN) {
+    return inf;
+  }
+
+  int m = small.size();
+  int n = large.size();
+  std::array<std::array<std::array<int, 2>, MAX_WORD_LEN + 1>, MAX_WORD_LEN + 1> dp{};
+  for (int i = 0; i <= m; i++) {
+    for (int j = 0; j <= n; j++) {
+      dp[i][j][0] = inf;
+      dp[i][j][1] = inf;
+    }
+  }
+  dp[0][0][0] = 0;
+  for (int i = 0; i <= m; i++) {
+    for (int j = 0; j < n; j++) {
+      if (i < m && small[i] == large[j]) {
+        dp[i + 1][j + 1][1] = std::min({dp[i + 1][j + 1][1], dp[i][j][0] + 1, dp[i][j][1]});
+      }
+      dp[i][j + 1][0] = std::min({dp[i][j + 1][0], dp[i][j][0], dp[i][j][1]});
+    }
+  }
+  return std::min(dp[m][n][0], dp[m][n][1]);
+}
+
+std::u16string randomWord(std::mt19937& rng, size_t length, int alphabet) {
+  std::u16string word;
+  for (size_t i = 0; i < length; i++) {
+    word.push_back(u'a' + rng() % alphabet);
+  }
+  return word;
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(42);
+  size_t matched = 0;
+  for (int round = 0; round < 500000; round++) {
+    const int alphabet = 1 + rng() % 4;
+    // Mostly short words, with some up to and just past MAX_WORD_LEN.
+    const size_t m = round % 50 == 0 ? rng() % (MAX_WORD_LEN + 2) : rng() % 8;
+    const size_t n = round % 10 == 0 ? rng() % (MAX_WORD_LEN + 2) : rng() % 14;
+    const std::u16string small = randomWord(rng, m, alphabet);
+    const std::u16string large = randomWord(rng, n, alphabet);
+    const int want = referenceGapMatch(small, large);
+    const int got = calcGapMatch(small, large);
+    if (want != got) {
+      std::cerr << "calcGapMatch(\"" << utf16ToUtf8(small) << "\", \"" << utf16ToUtf8(large) << "\") = " << got
+                << ", expected " << want << "\n";
+      return 1;
+    }
+    matched += want < 1e9;
+  }
+  std::cout << "500000 pairs, " << matched << " matched\n";
+  return 0;
+}
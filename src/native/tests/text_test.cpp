@@ -0,0 +1,404 @@
+// Checks the single-pass text kernels against the allocating functions they
+// replaced: normalize(), shorten(), utf8ToUtf16(), utf16ToUtf8() and
+// normalizeUtf16(). Covers every code point, alone and between ascii runs,
+// every byte pair, and random byte, UTF-8 and UTF-16 strings. The kernels
+// write into buffers of exactly their documented capacity, so building with
+// -fsanitize=address also checks those bounds.
+//
+//   cmake -S src/native/tests -B src/native/tests/build
+//   cmake --build src/native/tests/build
+//   ctest --test-dir src/native/tests/build
+
+#include "tagdb.hpp"
+
+#include <random>
+
+namespace reference {
+
+// The functions as they were, changed only where they were undefined: bytes
+// missing at the end of the input read as 0, and std::isspace() only sees
+// code points up to 0xff.
+static inline std::u16string utf8ToUtf16(const std::string& utf8) {
+  std::u16string utf16;
+  for (size_t i = 0; i < utf8.size();) {
+    uint32_t codepoint = 0;
+    size_t additionalBytes = 0;
+
+    if ((utf8[i] & 0x80) == 0) {
+      codepoint = utf8[i];
+      additionalBytes = 0;
+    } else if ((utf8[i] & 0xE0) == 0xC0) {
+      codepoint = utf8[i] & 0x1F;
+      additionalBytes = 1;
+    } else if ((utf8[i] & 0xF0) == 0xE0) {
+      codepoint = utf8[i] & 0x0F;
+      additionalBytes = 2;
+    } else if ((utf8[i] & 0xF8) == 0xF0) {
+      codepoint = utf8[i] & 0x07;
+      additionalBytes = 3;
+    } else {
+      return u"";
+    }
+
+    if (i + additionalBytes >= utf8.size()) {
+      return u"";
+    }
+
+    for (size_t j = 0; j < additionalBytes; ++j) {
+      codepoint = (codepoint << 6) | (utf8[i + j + 1] & 0x3F);
+    }
+
+    if (codepoint <= 0xFFFF) {
+      utf16.push_back(static_cast<char16_t>(codepoint));
+    } else {
+      codepoint -= 0x10000;
+      utf16.push_back(static_cast<char16_t>(0xD800 + (codepoint >> 10)));
+      utf16.push_back(static_cast<char16_t>(0xDC00 + (codepoint & 0x3FF)));
+    }
+
+    i += additionalBytes + 1;
+  }
+
+  return utf16;
+}
+
+static inline std::string utf16ToUtf8(std::u16string_view utf16) {
+    std::string utf8;
+    for (size_t i = 0; i < utf16.size(); ++i) {
+        uint32_t codepoint;
+
+        if (utf16[i] >= 0xD800 && utf16[i] <= 0xDBFF) {
+            if (i + 1 >= utf16.size() || utf16[i + 1] < 0xDC00 || utf16[i + 1] > 0xDFFF) {
+                return "";
+            }
+
+            codepoint = 0x10000 + ((utf16[i] - 0xD800) << 10) + (utf16[i + 1] - 0xDC00);
+            ++i;
+        } else {
+            codepoint = utf16[i];
+        }
+
+        if (codepoint <= 0x7F) {
+            utf8.push_back(static_cast<char>(codepoint));
+        } else if (codepoint <= 0x7FF) {
+            utf8.push_back(static_cast<char>((codepoint >> 6) | 0xC0));
+            utf8.push_back(static_cast<char>((codepoint & 0x3F) | 0x80));
+        } else if (codepoint <= 0xFFFF) {
+            utf8.push_back(static_cast<char>((codepoint >> 12) | 0xE0));
+            utf8.push_back(static_cast<char>(((codepoint >> 6) & 0x3F) | 0x80));
+            utf8.push_back(static_cast<char>((codepoint & 0x3F) | 0x80));
+        } else {
+            utf8.push_back(static_cast<char>((codepoint >> 18) | 0xF0));
+            utf8.push_back(static_cast<char>(((codepoint >> 12) & 0x3F) | 0x80));
+            utf8.push_back(static_cast<char>(((codepoint >> 6) & 0x3F) | 0x80));
+            utf8.push_back(static_cast<char>((codepoint & 0x3F) | 0x80));
+        }
+    }
+
+    return utf8;
+}
+
+static inline std::vector<uint32_t> utf8ToCodepoints(const std::string& utf8) {
+  std::vector<uint32_t> codepoints;
+  size_t i = 0;
+  // Reads past the end as 0 where the original read out of bounds.
+  auto at = [&](size_t k) -> char { return k < utf8.size() ? utf8[k] : 0; };
+  while (i < utf8.size()) {
+      uint32_t codepoint = 0;
+      unsigned char c = utf8[i];
+      if (c < 0x80) {
+          codepoint = c;
+          i += 1;
+      } else if (c < 0xE0) {
+          codepoint = ((c & 0x1F) << 6) | (at(i + 1) & 0x3F);
+          i += 2;
+      } else if (c < 0xF0) {
+          codepoint = ((c & 0x0F) << 12) | ((at(i + 1) & 0x3F) << 6) | (at(i + 2) & 0x3F);
+          i += 3;
+      } else {
+          codepoint = ((c & 0x07) << 18) | ((at(i + 1) & 0x3F) << 12) | ((at(i + 2) & 0x3F) << 6) | (at(i + 3) & 0x3F);
+          i += 4;
+      }
+      codepoints.push_back(codepoint);
+  }
+  return codepoints;
+}
+
+static inline std::string codepointToUtf8(char32_t codepoint) {
+    std::string utf8_string;
+
+    if (codepoint <= 0x7F) {
+      utf8_string += static_cast<char>(codepoint);
+    } else if (codepoint <= 0x7FF) {
+      utf8_string += static_cast<char>(0xC0 | ((codepoint >> 6) & 0x1F));
+      utf8_string += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else if (codepoint <= 0xFFFF) {
+      utf8_string += static_cast<char>(0xE0 | ((codepoint >> 12) & 0x0F));
+      utf8_string += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+      utf8_string += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else if (codepoint <= 0x10FFFF) {
+      utf8_string += static_cast<char>(0xF0 | ((codepoint >> 18) & 0x07));
+      utf8_string += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+      utf8_string += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+      utf8_string += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+
+    return utf8_string;
+}
+
+static inline int lconToCjamo(int ch) {
+    static const std::vector<int> table = {
+        0x3131, 0x3132, 0x3134, 0x3137, 0x3138, 0x3139, 0x3141, 0x3142,
+        0x3143, 0x3145, 0x3146, 0x3147, 0x3148, 0x3149, 0x314a, 0x314b,
+        0x314c, 0x314d, 0x314e
+    };
+    if (ch < 0x1100 || ch > 0x1112) {
+        if (ch == 0x1140) return 0x317f;
+        else if (ch == 0x114C) return 0x3181;
+        else if (ch == 0x1159) return 0x3186;
+        return ch;
+    }
+    return table[ch - 0x1100];
+}
+
+static inline int mvowToCjamo(int ch) {
+    static const std::vector<int> table = {
+        0x314f, 0x3150, 0x3151, 0x3152, 0x3153, 0x3154, 0x3155, 0x3156,
+        0x3157, 0x3158, 0x3159, 0x315a, 0x315b, 0x315c, 0x315d, 0x315e,
+        0x315f, 0x3160, 0x3161, 0x3162, 0x3163
+    };
+    if (ch < 0x1161 || ch > 0x1175) {
+        if (ch == 0x119E) return 0x318D;
+        return ch;
+    }
+    return table[ch - 0x1161];
+}
+
+static inline int fconToCjamo(int ch) {
+    static const std::vector<int> table = {
+        0x3131, 0x3132, 0x3133, 0x3134, 0x3135, 0x3136, 0x3137, 0x3139,
+        0x313a, 0x313b, 0x313c, 0x313d, 0x313e, 0x313f, 0x3140, 0x3141,
+        0x3142, 0x3144, 0x3145, 0x3146, 0x3147, 0x3148, 0x314a, 0x314b,
+        0x314c, 0x314d, 0x314e
+    };
+    if (ch < 0x11a8 || ch > 0x11c2) {
+        if (ch == 0x11EB) return 0x317f;
+        else if (ch == 0x11F0) return 0x3181;
+        else if (ch == 0x11F9) return 0x3186;
+        return ch;
+    }
+    return table[ch - 0x11a8];
+}
+
+static inline std::string normalizeJamo(uint32_t code) {
+  code = lconToCjamo(code);
+  code = mvowToCjamo(code);
+  code = fconToCjamo(code);
+
+  static const std::unordered_map<std::string, std::string> _complexJamo = {
+    {"ㅘ", "ㅗㅏ"}, {"ㅙ", "ㅗㅐ"}, {"ㅚ", "ㅗㅣ"}, {"ㅝ", "ㅜㅓ"},
+    {"ㅞ", "ㅜㅔ"}, {"ㅟ", "ㅜㅣ"}, {"ㅢ", "ㅡㅣ"},
+    {"ㄳ", "ㄱㅅ"}, {"ㄵ", "ㄴㅈ"}, {"ㄶ", "ㄴㅎ"}, {"ㄺ", "ㄹㄱ"},
+    {"ㄻ", "ㄹㅁ"}, {"ㄼ", "ㄹㅂ"}, {"ㄽ", "ㄹㅅ"}, {"ㄾ", "ㄹㅌ"},
+    {"ㄿ", "ㄹㅍ"}, {"ㅀ", "ㄹㅎ"}, {"ㅄ", "ㅂㅅ"},
+    {"ㄲ", "ㄱㄱ"}, {"ㄸ", "ㄷㄷ"}, {"ㅃ", "ㅂㅂ"}, {"ㅆ", "ㅅㅅ"}, {"ㅉ", "ㅈㅈ"}
+  };
+  static const std::unordered_map<uint32_t, std::string> complexJamo = [] {
+    std::unordered_map<uint32_t, std::string> result;
+    for (const auto& [key, value] : _complexJamo) {
+      const uint32_t code = utf8ToCodepoints(key)[0];
+      result[code] = value;
+    }
+    return result;
+  }();
+
+  if (complexJamo.find(code) != complexJamo.end()) {
+    return complexJamo.at(code);
+  }
+  return codepointToUtf8(code);
+}
+
+static inline std::string normalize(const std::string& word) {
+  std::string result;
+  std::vector<uint32_t> codepoints = utf8ToCodepoints(word);
+
+  const auto append = [&](const std::string& str) {
+    auto codepoints = utf8ToCodepoints(str);
+    for (uint32_t code : codepoints) {
+      result += normalizeJamo(code);
+    }
+  };
+
+  for (uint32_t code : codepoints) {
+    if (code >= 'A' && code <= 'Z') {
+      result.push_back(code - 'A' + 'a');
+    } else if ((code >= 'a' && code <= 'z') || (code >= '0' && code <= '9')) {
+      result.push_back(code);
+    } else if (code >= 0xAC00 && code <= 0xD7A3) {
+      int code_offset = code - 0xAC00;
+      int initial = code_offset / (21 * 28);
+      int medial = (code_offset % (21 * 28)) / 28;
+      int final = code_offset % 28;
+
+      static const std::vector<std::string> initialJamos = {
+        "ㄱ", "ㄲ", "ㄴ", "ㄷ", "ㄸ", "ㄹ", "ㅁ", "ㅂ", "ㅃ", "ㅅ",
+        "ㅆ", "ㅇ", "ㅈ", "ㅉ", "ㅊ", "ㅋ", "ㅌ", "ㅍ", "ㅎ"
+      };
+      static const std::vector<std::string> medialJamos = {
+        "ㅏ", "ㅐ", "ㅑ", "ㅒ", "ㅓ", "ㅔ", "ㅕ", "ㅖ", "ㅗ", "ㅘ",
+        "ㅙ", "ㅚ", "ㅛ", "ㅜ", "ㅝ", "ㅞ", "ㅟ", "ㅠ", "ㅡ", "ㅢ", "ㅣ"
+      };
+      static const std::vector<std::string> finalJamos = {
+        "", "ㄱ", "ㄲ", "ㄳ", "ㄴ", "ㄵ", "ㄶ", "ㄷ", "ㄹ", "ㄺ",
+        "ㄻ", "ㄼ", "ㄽ", "ㄾ", "ㄿ", "ㅀ", "ㅁ", "ㅂ", "ㅄ", "ㅅ",
+        "ㅆ", "ㅇ", "ㅈ", "ㅊ", "ㅋ", "ㅌ", "ㅍ", "ㅎ"
+      };
+
+      append(initialJamos[initial]);
+      append(medialJamos[medial]);
+      if (final != 0) {
+        append(finalJamos[final]);
+      }
+    } else {
+      append(codepointToUtf8(code));
+    }
+  }
+  return result;
+}
+
+static inline std::string shorten(const std::string& word) {
+  std::string result;
+  std::vector<uint32_t> codepoints = utf8ToCodepoints(word);
+
+  const uint32_t HANGUL_SYLLABLES_START = 0xAC00;
+  const uint32_t HANGUL_SYLLABLES_END = 0xD7A3;
+  const uint32_t CHOSUNG_BASE = 0x1100;
+
+  bool containsKorean = false;
+  for (uint32_t codepoint : codepoints) {
+    if (codepoint >= HANGUL_SYLLABLES_START && codepoint <= HANGUL_SYLLABLES_END) {
+      containsKorean = true;
+      break;
+    }
+  }
+
+  if (containsKorean) {
+    for (uint32_t codepoint : codepoints) {
+      if (codepoint >= HANGUL_SYLLABLES_START && codepoint <= HANGUL_SYLLABLES_END) {
+        uint32_t chosungIndex = (codepoint - HANGUL_SYLLABLES_START) / (21 * 28);
+        uint32_t chosungCodepoint = CHOSUNG_BASE + chosungIndex;
+        result += normalizeJamo(chosungCodepoint);
+      }
+    }
+  } else {
+    bool newWord = true;
+    for (uint32_t c : codepoints) {
+      if (c <= 0xFF && std::isspace(c)) { // std::isspace() is undefined past 0xff
+        newWord = true;
+      } else if (newWord && c >= 'a' && c <= 'z') {
+        result += c;
+        result += ' ';
+        newWord = false;
+      }
+    }
+  }
+  return result;
+}
+
+} // namespace reference
+
+namespace {
+
+size_t checks = 0;
+size_t failures = 0;
+
+void fail(const char* what, const std::string& input) {
+  if (failures++ < 10) {
+    std::cerr << what << " differs for";
+    for (unsigned char byte : input) {
+      std::cerr << " " << std::hex << int(byte) << std::dec;
+    }
+    std::cerr << "\n";
+  }
+}
+
+void checkUtf16(const std::u16string& input) {
+  std::vector<char> out(3 * input.size());
+  const std::string got(out.data(), utf16ToUtf8(input, out.data()));
+  if (got != reference::utf16ToUtf8(input) || utf16ToUtf8(input) != got) {
+    fail("utf16ToUtf8", reference::utf16ToUtf8(input));
+  }
+}
+
+void check(const std::string& input) {
+  checks++;
+  std::vector<char> bytes(normalizedCapacity(input.size()));
+  const std::string want = reference::normalize(input);
+  if (std::string(bytes.data(), normalize(input, bytes.data())) != want || normalize(input) != want) {
+    fail("normalize", input);
+  }
+  bytes.assign(shortenedCapacity(input.size()), 0);
+  const std::string shortened = reference::shorten(input);
+  if (std::string(bytes.data(), shorten(input, bytes.data())) != shortened || shorten(input) != shortened) {
+    fail("shorten", input);
+  }
+  std::vector<char16_t> units(input.size());
+  const std::u16string utf16 = reference::utf8ToUtf16(input);
+  if (std::u16string(units.data(), utf8ToUtf16(input, units.data())) != utf16 || utf8ToUtf16(input) != utf16) {
+    fail("utf8ToUtf16", input);
+  }
+  if (normalizeUtf16(input) != reference::utf8ToUtf16(want)) {
+    fail("normalizeUtf16", input);
+  }
+  checkUtf16(utf16);
+}
+
+} // namespace
+
+int main() {
+  for (uint32_t code = 0; code <= 0x10FFFF; code++) {
+    const std::string encoded = reference::codepointToUtf8(code);
+    check(encoded);
+    check("Ab" + encoded + "Zz09 xY");
+    check("ABCDEFGHIJ" + encoded + "KLMNOPQRSTUVWXYZ@[`{");
+  }
+  for (int first = 0; first < 256; first++) {
+    for (int second = 0; second < 256; second++) {
+      const std::string pair{char(first), char(second)};
+      check(pair);
+      check("abcdefgh" + pair);
+      check(pair + "\x80");
+    }
+  }
+
+  const std::vector<std::string> pieces = {
+    "a", "B", " ", "Z", "@", "[", "`", "{", "\x7f", "1", "가", "힣", "ㄲ", "ㅘ", "ㄳ", "ᄀ", "ᅡ", "ᆨ", "ᇫ",
+    "é", "日", "😀", "\xed", "\xf0\x9f", "\xc3", "\x80", "\xff", "\t", "\n", "Long Hair", "ｈ",
+  };
+  std::mt19937 rng(1);
+  for (int round = 0; round < 400000; round++) {
+    const size_t length = rng() % 24;
+    std::string input;
+    std::u16string units;
+    for (size_t i = 0; i < length; i++) {
+      input += round % 2 ? std::string(1, char(rng() % 256)) : pieces[rng() % pieces.size()];
+      // Lone and paired surrogates among ascii and the rest of the BMP.
+      switch (rng() % 6) {
+      case 0: units += char16_t(0xD800 + rng() % 0x800); break;
+      case 1: units += char16_t(rng() % 0x10000); break;
+      case 2: units += u'\xD83D'; break;
+      case 3: units += u'\xDE00'; break;
+      default: units += char16_t(rng() % 0x80); break;
+      }
+    }
+    check(input);
+    checkUtf16(units);
+  }
+
+  if (failures) {
+    std::cerr << failures << " of " << checks << " inputs differ\n";
+    return 1;
+  }
+  std::cout << checks << " inputs\n";
+  return 0;
+}
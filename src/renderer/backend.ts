@@ -32,7 +32,10 @@ export abstract class Backend {
   abstract zipFiles(files: FileEntry[], outPath: string): Promise<void>;
   abstract unzipFiles(tarPath: string, outPath: string): Promise<void>;
   abstract searchTags(word: string): Promise<any>;
+  abstract searchTagsMany(words: string[], k: number): Promise<any[][]>;
   abstract lookupTag(word: string): Promise<any>;
+  abstract lookupTags(words: string[]): Promise<any[]>;
+  abstract recordTagUsage(word: string): Promise<void>;
   abstract loadPiecesDB(pieces: string[]): Promise<void>;
   abstract searchPieces(word: string): Promise<any>;
   abstract listFiles(arg: string): Promise<string[]>;
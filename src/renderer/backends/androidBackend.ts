@@ -26,7 +26,15 @@ import ZipService from './zipService';
 import { FilePicker } from '@capawesome/capacitor-file-picker';
 import { Share } from '@capacitor/share';
 import { Clipboard } from '@capacitor/clipboard';
-import { WordTag } from '../models/Tags';
+import { exactWordTag } from '../models/Tags';
+import {
+  PIECES_CACHE_BYTES,
+  PIECES_DB_OPTIONS,
+  TAG_CACHE_BYTES,
+  USAGE_FILE,
+  debounceUsageSave,
+  diffPieces,
+} from './tagDBCommon';
 
 const APP_DIR = '.SDStudio';
 let config: Config = {};
@@ -104,10 +112,16 @@ export class AndroidBackend extends Backend {
   private imageGenService: ImageGenService;
   private tagDBId?: number;
   private piecesDBId?: number;
-  private tagMap: Map<string, WordTag>;
+  private tagSessionId?: number;
+  private saveTagUsage = debounceUsageSave(() =>
+    TagDB.saveUsage({ id: this.tagDBId!, usage: USAGE_FILE }),
+  );
+  private piecesSessionId?: number;
+  private loadedPieces = new Set<string>();
+  // Settles once the tag file is fully loaded; lookups wait for it.
+  private tagDBLoaded: Promise<void>;
   constructor() {
     super();
-    this.tagMap = new Map();
     Filesystem.mkdir({
       path: APP_DIR,
       recursive: true,
@@ -122,21 +136,74 @@ export class AndroidBackend extends Backend {
       await BackgroundMode.disableWebViewOptimizations();
     })();
 
-    (async () => {
-      this.tagDBId = (await TagDB.createDB({ name: 'tags' })).id;
-      this.piecesDBId = (await TagDB.createDB({ name: 'pieces' })).id;
-      await TagDB.loadDB({ id: this.tagDBId, path: DBCSV });
-      DBCSV.split('\n').forEach((x: string) => {
-        const comps: string[] = x.split(',');
-        if (comps.length !== 4) return;
-        this.tagMap.set(comps[0], {
-          word: comps[0],
-          normalized: comps[0],
-          freq: parseInt(comps[2]),
-          category: parseInt(comps[1]),
-          redirect: comps[3],
-          priority: 0,
+    this.tagDBLoaded = (async () => {
+      // Phones scan less and give up sooner so typing stays responsive.
+      this.tagDBId = (
+        await TagDB.createDB({
+          name: 'tags',
+          options: {
+            scanBudget: 800,
+            resultLimit: 128,
+            timeBudgetMs: 30,
+            fuzzyResults: 8,
+          },
+        })
+      ).id;
+      this.piecesDBId = (
+        await TagDB.createDB({ name: 'pieces', options: PIECES_DB_OPTIONS })
+      ).id;
+      this.tagSessionId = (
+        await TagDB.createSearchSession({ id: this.tagDBId })
+      ).id;
+      this.piecesSessionId = (
+        await TagDB.createSearchSession({ id: this.piecesDBId })
+      ).id;
+      await TagDB.setSearchThreads({ id: this.tagDBId, threads: 2 });
+      await TagDB.loadUsage({ id: this.tagDBId, usage: USAGE_FILE });
+      await TagDB.setCacheBudget({ id: this.tagDBId, bytes: TAG_CACHE_BYTES });
+      await TagDB.setCacheBudget({
+        id: this.piecesDBId,
+        bytes: PIECES_CACHE_BYTES,
+      });
+      // The loader maps the CSV from a file, so the bundled one is written
+      // out once per app version, through a rename so that an interrupted
+      // write is not taken for a whole file.
+      const dbFile = `db-${packageInfo.version}.csv`;
+      try {
+        await Filesystem.stat({ path: dbFile, directory: Directory.Data });
+      } catch (e) {
+        await Filesystem.writeFile({
+          path: `${dbFile}.tmp`,
+          data: DBCSV,
+          directory: Directory.Data,
+          encoding: Encoding.UTF8,
         });
+        await Filesystem.rename({
+          from: `${dbFile}.tmp`,
+          to: dbFile,
+          directory: Directory.Data,
+        });
+        // The copies earlier versions wrote, and any write they left
+        // unfinished, are several MB each.
+        const { files } = await Filesystem.readdir({
+          path: '',
+          directory: Directory.Data,
+        });
+        for (const file of files) {
+          const stale =
+            /^db-.*\.csv(\.tmp)?$/.test(file.name) && file.name !== dbFile;
+          if (stale) {
+            await Filesystem.deleteFile({
+              path: file.name,
+              directory: Directory.Data,
+            });
+          }
+        }
+      }
+      await TagDB.loadFile({
+        id: this.tagDBId,
+        path: dbFile,
+        snapshot: 'tags.snapshot',
       });
     })();
   }
@@ -252,27 +319,39 @@ export class AndroidBackend extends Backend {
   }
 
   async searchTags(word: string): Promise<any> {
-    const args = { id: this.tagDBId!, query: word };
-    return (await TagDB.search(args)).results;
+    const args = { id: this.tagSessionId!, query: word };
+    return (await TagDB.searchSession(args)).results;
+  }
+
+  async searchTagsMany(words: string[], k: number): Promise<any[][]> {
+    const args = { id: this.tagDBId!, queries: words, k };
+    return (await TagDB.searchMany(args)).results;
   }
 
   async lookupTag(word: string): Promise<any> {
-    return this.tagMap.get(word);
+    return exactWordTag(word, (await this.lookupTags([word]))[0]);
+  }
+
+  async lookupTags(words: string[]): Promise<any[]> {
+    await this.tagDBLoaded;
+    const args = { id: this.tagDBId!, tags: words };
+    return (await TagDB.lookupBatch(args)).results;
+  }
+
+  async recordTagUsage(word: string): Promise<void> {
+    const args = { id: this.tagDBId!, tag: word };
+    if ((await TagDB.recordUsage(args)).recorded) this.saveTagUsage();
   }
 
   async loadPiecesDB(pieces: string[]): Promise<void> {
-    const csv = pieces
-      .map((x: string) => {
-        return `<${x}>,0,0,null`;
-      })
-      .join('\n');
-    const args = { id: this.piecesDBId!, path: csv };
-    await TagDB.loadDB(args);
+    const { ops, words } = diffPieces(this.loadedPieces, pieces);
+    await TagDB.batchApply({ id: this.piecesDBId!, ops });
+    this.loadedPieces = words;
   }
 
   async searchPieces(word: string): Promise<any> {
-    const args = { id: this.piecesDBId!, query: word };
-    return (await TagDB.search(args)).results;
+    const args = { id: this.piecesSessionId!, query: word };
+    return (await TagDB.searchSession(args)).results;
   }
 
   async listFiles(arg: string): Promise<string[]> {
@@ -3,6 +3,7 @@ import { ImageAugmentInput, ImageGenInput, ImageGenService } from './imageGen';
 import { Backend, FileEntry, ResizeImageInput } from '../backend';
 import { NovelAiFetcher, NovelAiImageGenService } from './genVendors/nai';
 import { ImageContextAlt, SceneContextAlt } from '../models/types';
+import { unpackWordLists, unpackWords } from './packedWords';
 
 const invoke = window.electron?.ipcRenderer?.invoke;
 
@@ -92,19 +93,33 @@ export class ElectornBackend extends Backend {
   }
 
   async searchTags(word: string): Promise<any> {
-    return await invoke('search-tags', word);
+    const packed = await invoke('search-tags', word);
+    return packed ? unpackWords(packed) : [];
+  }
+
+  async searchTagsMany(words: string[], k: number): Promise<any[][]> {
+    return unpackWordLists(await invoke('search-tags-many', words, k));
   }
 
   async lookupTag(word: string): Promise<any> {
     return await invoke('lookup-tag', word);
   }
 
+  async lookupTags(words: string[]): Promise<any[]> {
+    return await invoke('lookup-tags', words);
+  }
+
+  async recordTagUsage(word: string): Promise<void> {
+    await invoke('record-tag-usage', word);
+  }
+
   async loadPiecesDB(pieces: string[]): Promise<void> {
     await invoke('load-pieces-db', pieces);
   }
 
   async searchPieces(word: string): Promise<any> {
-    return await invoke('search-pieces', word);
+    const packed = await invoke('search-pieces', word);
+    return packed ? unpackWords(packed) : [];
   }
 
   async listFiles(arg: string): Promise<string[]> {
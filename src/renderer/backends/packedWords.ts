@@ -0,0 +1,50 @@
+// Search results as packed by the native tag database: typed-array columns
+// over one buffer that also holds the UTF-8 strings of every row. See
+// PackedLayout in src/native/tagdb.hpp.
+export interface PackedWords {
+  count: number;
+  freq: Float64Array;
+  category: Int32Array;
+  priority: Int32Array;
+  offsets: Uint32Array;
+  strings: Uint8Array;
+}
+
+// Several result lists in one buffer: list i is words queryOffsets[i] to
+// queryOffsets[i + 1].
+export interface PackedWordLists extends PackedWords {
+  queryOffsets: Uint32Array;
+}
+
+const decoder = new TextDecoder();
+
+export function unpackWords(packed: PackedWords) {
+  const field = (i: number) =>
+    decoder.decode(
+      packed.strings.subarray(packed.offsets[i], packed.offsets[i + 1]),
+    );
+  const words = [];
+  for (let i = 0; i < packed.count; i++) {
+    words.push({
+      normalized: field(4 * i),
+      shortened: field(4 * i + 1),
+      word: field(4 * i + 2),
+      redirect: field(4 * i + 3),
+      freq: packed.freq[i],
+      priority: packed.priority[i],
+      category: packed.category[i],
+    });
+  }
+  return words;
+}
+
+export function unpackWordLists(packed: PackedWordLists) {
+  const words = unpackWords(packed);
+  const lists = [];
+  for (let i = 0; i + 1 < packed.queryOffsets.length; i++) {
+    lists.push(
+      words.slice(packed.queryOffsets[i], packed.queryOffsets[i + 1]),
+    );
+  }
+  return lists;
+}
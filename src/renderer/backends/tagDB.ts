@@ -7,14 +7,120 @@ declare module '@capacitor/core' {
   }
 }
 
+// Budgets of a search; see SearchOptions in tagdb.hpp. Keys left out keep
+// the database's values.
+export interface SearchOptions {
+  scanBudget?: number;
+  resultLimit?: number;
+  scoreShortened?: boolean;
+  timeBudgetMs?: number;
+  fuzzyResults?: number;
+  fuzzyEdits?: number;
+  fuzzyTimeBudgetMs?: number;
+}
+
 export interface TagDBPlugin {
-  createDB(options: { name: string }): Promise<{ id: number }>;
+  createDB(options: {
+    name: string;
+    options?: SearchOptions;
+  }): Promise<{ id: number }>;
   search(options: {
     id: number;
     query: string;
+    options?: SearchOptions;
   }): Promise<{ results: WordTag[] }>;
-  loadDB(options: { id: number; path: string }): Promise<void>;
+  lookupBatch(options: {
+    id: number;
+    tags: string[];
+  }): Promise<{ results: ((WordTag & { canonical: string }) | null)[] }>;
+  searchMany(options: {
+    id: number;
+    queries: string[];
+    k?: number;
+    options?: SearchOptions;
+  }): Promise<{ results: WordTag[][] }>;
+  loadDB(options: {
+    id: number;
+    csv: string;
+    snapshot?: string;
+  }): Promise<void>;
+  // path is relative to the app's files directory. Searches made before
+  // this resolves see the rows loaded so far; getLoadStats() reports
+  // complete: 0 for them.
+  loadFile(options: {
+    id: number;
+    path: string;
+    snapshot?: string;
+  }): Promise<{ loaded: boolean }>;
+  getLoadStats(options: { id: number }): Promise<Record<string, number>>;
+  getDanglingRedirects(options: {
+    id: number;
+  }): Promise<{ redirects: string[] }>;
+  setLoadThreads(options: { id: number; threads: number }): Promise<void>;
+  setSearchThreads(options: { id: number; threads: number }): Promise<void>;
+  getCacheStats(options: { id: number }): Promise<Record<string, number>>;
+  setCacheBudget(options: { id: number; bytes: number }): Promise<void>;
+  getSearchOptions(options: { id: number }): Promise<Required<SearchOptions>>;
+  setSearchOptions(options: {
+    id: number;
+    options: SearchOptions;
+  }): Promise<void>;
+  getStats(options: {
+    id: number;
+  }): Promise<{ [key: string]: number | Record<string, number[]> }>;
+  resetStats(options: { id: number }): Promise<void>;
+  setStatsEnabled(options: { id: number; enabled: boolean }): Promise<void>;
+  saveSnapshot(options: {
+    id: number;
+    snapshot: string;
+    source: string;
+  }): Promise<{ saved: boolean }>;
+  loadSnapshot(options: {
+    id: number;
+    snapshot: string;
+    source: string;
+  }): Promise<{ loaded: boolean }>;
+  // Counts tag as an accepted completion, which ranks it higher. usage
+  // names a file in the app's files directory.
+  recordUsage(options: {
+    id: number;
+    tag: string;
+  }): Promise<{ recorded: boolean }>;
+  saveUsage(options: {
+    id: number;
+    usage: string;
+  }): Promise<{ saved: boolean }>;
+  loadUsage(options: {
+    id: number;
+    usage: string;
+  }): Promise<{ loaded: boolean }>;
+  upsert(options: {
+    id: number;
+    word: string;
+    category?: number;
+    freq?: number;
+    redirect?: string;
+  }): Promise<{ applied: boolean }>;
+  remove(options: { id: number; word: string }): Promise<{ applied: boolean }>;
+  batchApply(options: {
+    id: number;
+    ops: {
+      word: string;
+      category?: number;
+      freq?: number;
+      redirect?: string;
+      remove?: boolean;
+    }[];
+  }): Promise<{ applied: number }>;
   releaseDB(options: { id: number }): Promise<void>;
+  createSearchSession(options: { id: number }): Promise<{ id: number }>;
+  searchSession(options: {
+    id: number;
+    query: string;
+    options?: SearchOptions;
+  }): Promise<{ results: WordTag[] }>;
+  releaseSearchSession(options: { id: number }): Promise<void>;
+  getMemoryUsage(options: { id: number }): Promise<Record<string, number>>;
 }
 
 const TagDB = registerPlugin<TagDBPlugin>('TagDB');
@@ -0,0 +1,45 @@
+// Setup and upkeep of the native tag databases that the Electron main
+// process and the Android backend share.
+
+// A few hundred piece names never need the tag database's budgets.
+export const PIECES_DB_OPTIONS = { scanBudget: 400, resultLimit: 64 };
+
+// Tag searches come from every prompt edit; piece names are few and rarely
+// searched.
+export const TAG_CACHE_BYTES = 4 << 20;
+export const PIECES_CACHE_BYTES = 256 << 10;
+
+// Usage counts of accepted completions, in the app's data directory. Missing
+// on first run; counts loaded before the tags carry over to their rows.
+export const USAGE_FILE = 'tags.usage';
+
+export interface PieceOp {
+  word: string;
+  remove?: boolean;
+}
+
+// Pieces change a few at a time, so only the difference to the loaded set is
+// applied instead of reloading the database. Returns the ops that turn
+// loaded into pieces, and the set loaded afterwards.
+export function diffPieces(loaded: Set<string>, pieces: string[]) {
+  const words = new Set<string>(pieces.map((x: string) => `<${x}>`));
+  const ops: PieceOp[] = [];
+  loaded.forEach((word) => {
+    if (!words.has(word)) ops.push({ word, remove: true });
+  });
+  words.forEach((word) => {
+    if (!loaded.has(word)) ops.push({ word });
+  });
+  return { ops, words };
+}
+
+// Completions come in bursts while typing, so the usage file is saved once
+// they settle rather than on every accepted tag. Returns the function to
+// call after each one.
+export function debounceUsageSave(save: () => unknown): () => void {
+  let timer: ReturnType<typeof setTimeout> | undefined;
+  return () => {
+    clearTimeout(timer);
+    timer = setTimeout(save, 5000);
+  };
+}
@@ -1334,6 +1334,10 @@ const PromptEditTextArea = observer(
       const tag = tagsRef.current[selectedTagRef.current];
       const tagWord =
         tag.redirect.trim() !== 'null' ? tag.redirect.trim() : tag.word;
+      // Accepted tags rank higher next time; pieces are not tags.
+      if (!curWordRef.current.startsWith('<')) {
+        backend.recordTagUsage(tagWord);
+      }
       const newWord = replaceMiddleWord(curWordRef.current, tagWord);
       editorRef.current!.setCurWord(newWord);
       closeAutoComplete();
@@ -1344,6 +1348,10 @@ const PromptEditTextArea = observer(
       const tag = tagsRef.current[idx];
       const tagWord =
         tag.redirect.trim() !== 'null' ? tag.redirect.trim() : tag.word;
+      // Accepted tags rank higher next time; pieces are not tags.
+      if (!curWordRef.current.startsWith('<')) {
+        backend.recordTagUsage(tagWord);
+      }
       const newWord = replaceMiddleWord(curWordRef.current, tagWord);
       editorRef.current!.setCurWord(newWord);
       closeAutoComplete();
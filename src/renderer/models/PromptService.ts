@@ -9,6 +9,7 @@ import {
   Scene,
   Session,
 } from './types';
+import { exactWordTag } from './Tags';
 
 export function cleanPARR(parr: PARR): PARR {
   return parr.map((p) => p.trim());
@@ -180,7 +181,9 @@ export const createSDPrompts = async (
         const newFront = [];
         const rest = [];
         const regex = /^\d+(boy|girl|other)s?$/;
-        for (const word of front) {
+        const tags = await backend.lookupTags(front);
+        for (let i = 0; i < front.length; i++) {
+          const word = front[i];
           if (
             regex.test(word) ||
             word === 'multiple girls' ||
@@ -189,7 +192,7 @@ export const createSDPrompts = async (
           ) {
             newFront.push(word);
           } else {
-            const tag = await backend.lookupTag(word);
+            const tag = exactWordTag(word, tags[i]);
             if (tag && tag.category === 4) {
               newFront.push(word);
             } else {
@@ -9,6 +9,21 @@ export interface WordTag {
 
 export const inf = 1e9 | 0;
 
+// A lookupTags() row as a WordTag of exactly word, the way tags were looked
+// up before the batched lookup: no match through the normalized form, and
+// normalized holds the word as written.
+export function exactWordTag(word: string, row: any): WordTag | undefined {
+  if (!row || row.word !== word) return undefined;
+  return {
+    normalized: row.word,
+    word: row.word,
+    redirect: row.redirect,
+    freq: row.freq,
+    priority: 0,
+    category: row.category,
+  };
+}
+
 export function normalize(word: string) {
   let result = '';
   let mapping = [];